@@ -0,0 +1,156 @@
+/*
+ * anillo.h - Anillo acotado de un productor y un consumidor sin cerrojos
+ *
+ * Bandeja de entrada de una conexión: el hilo receptor (recvMSGAsync) mete
+ * mensajes y la aplicación los saca. Cada índice lo escribe un solo hilo y
+ * va en su propia línea de caché, así que meter y sacar son una lectura y
+ * una escritura atómicas sin cerrojos ni reservas de memoria.
+ *
+ * Las esperas (anillo lleno para el productor, vacío para el consumidor)
+ * usan un mutex y una variable de condición solo en el camino lento: quien
+ * va a dormir lo anuncia con un indicador y el otro lado solo toma el mutex
+ * para avisar si lo ve activo. cerrar despierta a los dos para siempre.
+ */
+
+#ifndef _ANILLO_H_
+#define _ANILLO_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+template<typename T>
+class AnilloSPSC {
+
+public:
+    // La capacidad se redondea a la siguiente potencia de 2
+    explicit AnilloSPSC(size_t capacidadMinima) : capacidad(1) {
+        while (capacidad < capacidadMinima) {
+            capacidad <<= 1;
+        }
+        elementos = new T[capacidad];
+        escritura.valor.store(0, std::memory_order_relaxed);
+        lectura.valor.store(0, std::memory_order_relaxed);
+        productorEsperando.store(false, std::memory_order_relaxed);
+        consumidorEsperando.store(false, std::memory_order_relaxed);
+        cerrado.store(false, std::memory_order_relaxed);
+    }
+
+    ~AnilloSPSC() {
+        delete[] elementos;
+    }
+
+    AnilloSPSC(const AnilloSPSC&) = delete;
+    AnilloSPSC& operator=(const AnilloSPSC&) = delete;
+
+    // Solo el productor. false si está lleno
+    bool meter(const T& valor) {
+        size_t e = escritura.valor.load(std::memory_order_relaxed);
+        if (e - lectura.valor.load(std::memory_order_acquire) >= capacidad) {
+            return false;
+        }
+        elementos[e & (capacidad - 1)] = valor;
+        escritura.valor.store(e + 1, std::memory_order_seq_cst);
+        if (consumidorEsperando.load(std::memory_order_seq_cst)) {
+            avisar();
+        }
+        return true;
+    }
+
+    // Solo el consumidor. false si está vacío
+    bool sacar(T& valor) {
+        size_t l = lectura.valor.load(std::memory_order_relaxed);
+        if (l == escritura.valor.load(std::memory_order_acquire)) {
+            return false;
+        }
+        valor = elementos[l & (capacidad - 1)];
+        lectura.valor.store(l + 1, std::memory_order_seq_cst);
+        if (productorEsperando.load(std::memory_order_seq_cst)) {
+            avisar();
+        }
+        return true;
+    }
+
+    // Como meter, pero espera a que haya sitio. false si se cerró
+    bool meterEsperando(const T& valor) {
+        while (!meter(valor)) {
+            std::unique_lock<std::mutex> lock(esperaMutex);
+            productorEsperando.store(true, std::memory_order_seq_cst);
+            cambio.wait(lock, [this]() { return cerrado.load() || !lleno(); });
+            productorEsperando.store(false, std::memory_order_relaxed);
+            if (cerrado.load()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Como sacar, pero espera a que haya algo. false si se cerró y está vacío
+    bool sacarEsperando(T& valor) {
+        while (!sacar(valor)) {
+            std::unique_lock<std::mutex> lock(esperaMutex);
+            consumidorEsperando.store(true, std::memory_order_seq_cst);
+            cambio.wait(lock, [this]() { return cerrado.load() || !vacio(); });
+            consumidorEsperando.store(false, std::memory_order_relaxed);
+            if (cerrado.load() && vacio()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Despierta a quien espere; después meterEsperando falla y
+    // sacarEsperando solo devuelve lo que quede
+    void cerrar() {
+        {
+            std::lock_guard<std::mutex> lock(esperaMutex);
+            cerrado.store(true);
+        }
+        cambio.notify_all();
+    }
+
+    bool estaCerrado() const {
+        return cerrado.load();
+    }
+
+    bool vacio() const {
+        return lectura.valor.load(std::memory_order_seq_cst) ==
+               escritura.valor.load(std::memory_order_seq_cst);
+    }
+
+    bool lleno() const {
+        return escritura.valor.load(std::memory_order_seq_cst) -
+               lectura.valor.load(std::memory_order_seq_cst) >= capacidad;
+    }
+
+    size_t size() const {
+        return escritura.valor.load(std::memory_order_acquire) -
+               lectura.valor.load(std::memory_order_acquire);
+    }
+
+private:
+    // Índice en su propia línea de caché, como los contadores de registro.h
+    struct Indice {
+        std::atomic<size_t> valor;
+        char relleno[64 - sizeof(std::atomic<size_t>)];
+    };
+
+    void avisar() {
+        { std::lock_guard<std::mutex> lock(esperaMutex); }
+        cambio.notify_all();
+    }
+
+    char rellenoInicio[64];     // Separa escritura de lo anterior en memoria
+    Indice escritura;
+    Indice lectura;
+    size_t capacidad;
+    T* elementos;
+    std::atomic<bool> productorEsperando;
+    std::atomic<bool> consumidorEsperando;
+    std::atomic<bool> cerrado;
+    std::mutex esperaMutex;
+    std::condition_variable cambio;
+};
+
+#endif
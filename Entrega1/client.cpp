@@ -26,11 +26,14 @@ int main(int argc,char** argv)
     cout << "Conexion establecida exitosamente" << endl;
     cout << "Socket: " << conn.socket << ", Server ID: " << conn.serverId << endl;
 
+    // Reservar el paquete completo una sola vez
+    PacketWriter writer(buffer, sizeof(int) + mensaje.size());
+
     // Empaquetar el tamaño del mensaje
-    pack(buffer, (int)mensaje.size());
+    writer.write((int)mensaje.size());
 
     // Empaquetar el contenido del mensaje
-    packv(buffer, (char*)mensaje.data(), mensaje.size());
+    writer.writev(mensaje);
 
     cout << "Buffer preparado, tamano: " << buffer.size() << " bytes" << endl;
 
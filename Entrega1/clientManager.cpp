@@ -4,152 +4,599 @@
 
 
 
+void clientManager::escribeTipo(PacketWriter &writer, msgTypes type, int version)
+{
+	if(version==PROTOCOL_V1)
+		writer.write(type);
+	else
+		writer.write((unsigned char)type);
+}
+
+void clientManager::escribeEntero(PacketWriter &writer, unsigned int value, int version)
+{
+	if(version==PROTOCOL_V1)
+		writer.write(value);
+	else
+		writer.writeVarint(value);
+}
+
+void clientManager::escribeCadena(PacketWriter &writer, string_view str, int version)
+{
+	if(version==PROTOCOL_V1)
+		writer.writeString(str);
+	else
+		writer.writeStringV2(str);
+}
+
+void clientManager::escribeCuerpo(PacketWriter &writer, string_view str, int version)
+{
+	if(version==PROTOCOL_V1)
+		writer.writeString(str);
+	else
+		writer.writev(str);
+}
+
+clientManager::msgTypes clientManager::leeTipo(PacketReader &reader, int version)
+{
+	if(version==PROTOCOL_V1)
+		return reader.read<msgTypes>();
+	return (msgTypes)reader.read<unsigned char>();
+}
+
+unsigned int clientManager::leeEntero(PacketReader &reader, int version)
+{
+	if(version==PROTOCOL_V1)
+		return reader.read<unsigned int>();
+	return reader.readVarint();
+}
+
+string_view clientManager::leeCadena(PacketReader &reader, int version)
+{
+	if(version==PROTOCOL_V1)
+		return desempaquetaTipoTexto(reader);
+	return reader.readStringV2();
+}
+
+string_view clientManager::leeCuerpo(PacketReader &reader, int version)
+{
+	if(version==PROTOCOL_V1)
+		return desempaquetaTipoTexto(reader);
+	return reader.view(reader.remaining());
+}
+
+unsigned int clientManager::reservaSecuencia()
+{
+	//espera a que haya sitio en la ventana de envíos sin confirmar
+	unique_lock<mutex> lock(cerrojoBuffers);
+	cvAcks.wait(lock,[](){
+		return desconectado || ultimaSecuencia-ultimoAck<ventanaEnvio;
+	});
+	return ++ultimaSecuencia;
+}
+
 void clientManager::enviaMensaje(int id, string mensaje)
 {
+	enviaPeticion(id,texto,mensaje);
+}
+
+void clientManager::enviaUnirse(int id, string sala)
+{
+	enviaPeticion(id,unirse,sala);
+}
+
+void clientManager::enviaAbandonar(int id)
+{
+	enviaPeticion(id,abandonar,"");
+}
+
+void clientManager::enviaPrivado(int id, string destino, string mensaje)
+{
+	enviaPeticion(id,privado,mensaje,destino);
+}
+
+void clientManager::enviaPeticion(int id, msgTypes type, string_view cuerpo, string_view destino)
+{
+	//el orden de las secuencias debe ser el orden en el socket
+	lock_guard<mutex> envio(cerrojoEnvio);
+	unsigned int seq=reservaSecuencia();
+	int version=versionProtocolo;
+
 	vector<unsigned char> buffer; //para crear un paquete de datos
-	//empaquetar tipo
-	pack(buffer,texto);
-	//empaquetar datos
-		//empaquetar tamaño de string
-	pack(buffer,mensaje.size());
-			//empaquetar datos de string
-	packv(buffer,mensaje.data(),mensaje.size());
-		//enviar datos
-	sendMSG(id,buffer);
-	//recibir respuesta
-		//limpiar buffer
-	//consultar ack
-	while(bufferAcks.size()==0) usleep(100); //espera semidurmiente
-	//leer ack
-	cerrojoBuffers.lock();
-	if(unpack<int>(bufferAcks)!= ack)
+	PacketWriter writer(buffer,sizeof(msgTypes)+sizeof(seq)+2*sizeof(long int)+destino.size()+cuerpo.size());
+	//empaquetar tipo y secuencia
+	escribeTipo(writer,type,version);
+	escribeEntero(writer,seq,version);
+	if(type==privado)
+		escribeCadena(writer,destino,version);
+	//empaquetar datos: tamaño de string (solo v1) y datos de string
+	escribeCuerpo(writer,cuerpo,version);
+		//enviar datos sin esperar el ack: lo recoge recibeMensaje
+	bool enviado;
+	vector<unsigned char> comprimido;
+	if(compresion && compressFrame(buffer,comprimido))
+		enviado=sendFrame(id,comprimido,PROTOCOL_V2,FRAME_LZ);
+	else
+		enviado=sendFrame(id,buffer,version);
+	if(!enviado)
 		cout<<"Error enviando mensaje\n";
-	cerrojoBuffers.unlock();
 }
 
-string clientManager::desempaquetaTipoTexto(vector<unsigned char> &buffer){
+string_view clientManager::desempaquetaTipoTexto(PacketReader &reader){
 
-	string mensaje;
-	//para crear un paquete de datos
-	mensaje.resize(unpack<long int>(buffer));
-	unpackv(buffer,(char*)mensaje.data(),mensaje.size());
-	return mensaje;
+	//vista sobre el paquete, sin copiar el texto
+	return reader.readString();
 }
 
 void clientManager::enviaLogin(int id, string userName){
 
-	//buffer datos
-	vector<unsigned char> buffer;
-	//empaquetar tipo de mensaje
-	pack(buffer,login);
-	//empaquetar metadato
-	pack(buffer,userName.size());
-	//dato
-	packv(buffer, userName.data(),userName.size());
-	//enviar
-	sendMSG(id,buffer);
-	//consultar ack
-	while(bufferAcks.size()==0) usleep(100); //espera semidurmiente
-	//leer ack
-	cerrojoBuffers.lock();
-	if(unpack<int>(bufferAcks)!= ack)
+	unsigned int seq;
+	{
+		lock_guard<mutex> envio(cerrojoEnvio);
+		seq=reservaSecuencia();
+		int version=versionProtocolo;
+
+		//buffer datos
+		vector<unsigned char> buffer;
+		PacketWriter writer(buffer,sizeof(msgTypes)+3*sizeof(seq)+sizeof(long int)+userName.size());
+		//empaquetar tipo de mensaje y secuencia
+		escribeTipo(writer,login,version);
+		escribeEntero(writer,seq,version);
+		//empaquetar metadato y dato
+		escribeCadena(writer,userName,version);
+		//versión más alta que entiende el cliente, al final para que un
+		//servidor que solo conoce v1 la ignore
+		if(version==PROTOCOL_V1){
+			writer.write((unsigned int)versionOfrecida);
+			writer.write(capacidadesOfrecidas);
+		}
+		//enviar
+		if(!sendFrame(id,buffer,version))
+			cout<<"Error enviando mensaje\n";
+	}
+	//el login sí espera a su confirmación, que trae la versión acordada
+	if(!esperaAck(seq))
 		cout<<"Error enviando mensaje\n";
-	cerrojoBuffers.unlock();
 
 }
 
+void clientManager::configuraVentana(unsigned int ventana)
+{
+	lock_guard<mutex> lock(cerrojoBuffers);
+	ventanaEnvio=ventana>0 ? ventana : 1;
+	cvAcks.notify_all();
+}
+
+bool clientManager::esperaAck(unsigned int seq)
+{
+	unique_lock<mutex> lock(cerrojoBuffers);
+	//comparación con signo para que funcione al dar la vuelta el contador
+	cvAcks.wait(lock,[seq](){
+		return desconectado || (int)(ultimoAck-seq)>=0;
+	});
+	return (int)(ultimoAck-seq)>=0;
+}
+
+void clientManager::procesaAck(unsigned int seq)
+{
+	lock_guard<mutex> lock(cerrojoBuffers);
+	//ack acumulativo: confirma seq y todas las anteriores
+	if((int)(seq-ultimoAck)>0)
+		ultimoAck=seq;
+	cvAcks.notify_all();
+}
+
+vector<unsigned char> clientManager::empaquetaAck(unsigned int seq, int version, int versionAcordada,
+                                                  int capacidadesAcordadas)
+{
+	vector<unsigned char> bufferOut;
+	PacketWriter writer(bufferOut,sizeof(msgTypes)+3*sizeof(seq));
+	escribeTipo(writer,ack,version);
+	escribeEntero(writer,seq,version);
+	//solo el ack de un login que ofreció versión (y capacidades) las lleva
+	if(versionAcordada>0)
+		writer.write((unsigned int)versionAcordada);
+	if(versionAcordada>0 && capacidadesAcordadas>=0)
+		writer.write((unsigned int)capacidadesAcordadas);
+	return bufferOut;
+}
+
 
 void clientManager::atiendeCliente(int clientID)
 {
 	vector<unsigned char> bufferIn;
 	bool salir=false;
-	string userName="default";
+	int idUsuario=-1; //sin login todavía
+	unsigned int seq=0; //última secuencia recibida
+	int version=PROTOCOL_V1; //hasta que se acuerde otra en el login
 	while(!salir){
-		//recibe paquete datos
-		recvMSG(clientID,bufferIn);
-		//desempaquetar tipo paquete
-		msgTypes type=unpack<msgTypes>(bufferIn);
-		//dependiendo de tipo
-		switch(type){
-			//tipo texto
-			case texto:{
-				//desempaquetar mensaje
-				string msg=desempaquetaTipoTexto(bufferIn);
-				//reenviar
-				reenviaTexto(userName,msg);
-			}break;
-			//tipo exit
-			case exit:{
-				//eliminar usuario
-				connectionIds.erase(userName);
-				//cerrar conexión
-				salir=true;
-			}break;//tipo login
-			case login:{
-				//desempaquetar usuario
-				userName=desempaquetaTipoTexto(bufferIn);
-				//añadir si no existe
-				if(connectionIds.find(userName)==connectionIds.end())
-					connectionIds[userName]=clientID;
-				else
+		//recibe paquete datos (vista sobre el buffer de lectura de la conexión)
+		PacketReader reader(nullptr,0);
+		if(!recvFrame(clientID,reader)){
+			//conexión cerrada por el cliente
+			if(idUsuario>=0)
+				eliminaUsuario(idUsuario);
+			break;
+		}
+		bool ackEnviado=false;
+		//una trama corta o mal formada cierra la conexión como un tipo desconocido
+		try{
+			//desempaquetar tipo paquete
+			msgTypes type=leeTipo(reader,version);
+			//dependiendo de tipo
+			switch(type){
+				//tipo texto
+				case texto:{
+					seq=leeEntero(reader,version);
+					//desempaquetar mensaje
+					string_view msg=leeCuerpo(reader,version);
+					//reenviar (solo usuarios con login)
+					if(idUsuario>=0)
+						reenviaTexto(idUsuario,msg);
+				}break;
+				//texto para un solo usuario
+				case privado:{
+					seq=leeEntero(reader,version);
+					string_view destino=leeCadena(reader,version);
+					string_view msg=leeCuerpo(reader,version);
+					if(idUsuario>=0)
+						reenviaPrivado(idUsuario,destino,msg);
+				}break;
+				//cambio de sala
+				case unirse:{
+					seq=leeEntero(reader,version);
+					string_view sala=leeCuerpo(reader,version);
+					if(idUsuario>=0)
+						cambiaSala(idUsuario,obtieneSala(sala));
+				}break;
+				case abandonar:{
+					seq=leeEntero(reader,version);
+					if(idUsuario>=0)
+						cambiaSala(idUsuario,salaGeneral);
+				}break;
+				//tipo exit
+				case exit:{
+					seq=leeEntero(reader,version);
+					//eliminar usuario
+					if(idUsuario>=0)
+						eliminaUsuario(idUsuario);
+					//cerrar conexión
 					salir=true;
-			}break;
-			default:{
-			//cualquier otro tipo
-				ERRLOG ("tipo mensaje no válido");
-				//eliminar usuario
-				connectionIds.erase(userName);
-				//cerrar conexión
-				salir=true;
-			}break;
-		};
-
-		//limpiar buffer
-		bufferIn.clear();
-		//enviar ack
-		pack(bufferIn,ack);
-		sendMSG(clientID,bufferIn);
+				}break;//tipo login
+				case login:{
+					seq=leeEntero(reader,version);
+					//desempaquetar usuario
+					string userName(leeCadena(reader,version));
+					//versión ofrecida (un cliente antiguo no la envía)
+					int ofrecida=0;
+					int capacidades=-1;
+					if(version==PROTOCOL_V1 && reader.remaining()>=sizeof(unsigned int))
+						ofrecida=reader.read<unsigned int>();
+					if(ofrecida>0 && reader.remaining()>=sizeof(unsigned int))
+						capacidades=reader.read<unsigned int>();
+					int acordada=version;
+					if(ofrecida>0)
+						acordada=ofrecida<versionServidor ? ofrecida : versionServidor;
+					//la compresión necesita los flags de la cabecera v2
+					if(capacidades>=0)
+						capacidades&=acordada>=PROTOCOL_V2 ? capacidadesServidor : 0;
+					bool comprime=capacidades>0 && (capacidades&capacidadLZ);
+					//añadir si no está ya conectado
+					if(idUsuario<0){
+						vector<unsigned char> ackLogin=empaquetaAck(seq,version,ofrecida>0 ? acordada : 0,capacidades);
+						idUsuario=registraUsuario(userName,clientID,ackLogin,version,acordada,comprime);
+						if(idUsuario>=0){
+							//desde aquí las tramas van en la versión acordada
+							ackEnviado=true;
+							version=acordada;
+							setProtocolVersion(clientID,version);
+						}
+					}
+					if(idUsuario<0)
+						salir=true;
+				}break;
+				default:{
+				//cualquier otro tipo
+					ERRLOG ("tipo mensaje no válido");
+					//eliminar usuario
+					if(idUsuario>=0)
+						eliminaUsuario(idUsuario);
+					//cerrar conexión
+					salir=true;
+				}break;
+			};
+		}
+		catch(const out_of_range&){
+			ERRLOG ("trama mal formada");
+			if(idUsuario>=0)
+				eliminaUsuario(idUsuario);
+			salir=true;
+		}
+
+		//ack acumulativo: solo cuando no quedan tramas ya recibidas por
+		//procesar, así un lote de mensajes se confirma con un único ack
+		if(!ackEnviado && (salir || !pendingFrame(clientID))){
+			bufferIn=empaquetaAck(seq,version,0);
+			sendFrame(clientID,bufferIn,version);
+		}
 	}
 	closeConnection(clientID);
 }
 
-void clientManager::reenviaTexto(string userName, string msg)
+int clientManager::registraUsuario(const string &userName, int clientID,
+                                   vector<unsigned char> &ackLogin, int version, int versionAcordada,
+                                   bool comprime)
 {
-	//empaquetar mensaje
-	vector<unsigned char> bufferOut;
-	pack(bufferOut,texto); //tipo
-	pack(bufferOut,userName.size());
-	packv(bufferOut,userName.data(),userName.size());
-	pack(bufferOut,msg.size());
-	packv(bufferOut,msg.data(),msg.size());
-
-	//por cada cliente conectado
-	for(  auto client  : connectionIds){
+	unsigned int idUsuario;
+	vector<conectado_t> destinos;
+	//el nuevo recibe los nombres y el ack del login antes del alta, así
+	//ningún reenvío puede llegarle con un ID que aún no conoce o en una
+	//versión que aún no ha activado. Los envíos van sin el cerrojo: se le
+	//anuncian los conectados que no conoce hasta que, con el cerrojo tomado,
+	//no queda ninguno, y entonces se le da de alta
+	vector<bool> anunciado;
+	bool primero=true;
+	while(true){
+		vector<unsigned int> ids;
+		vector<string> nombres;
+		{
+			unique_lock<shared_mutex> lock(cerrojoUsuarios);
+			if(primero){
+				int id=idsUsuario.buscar(userName);
+				if(id<0){
+					//primer login con este nombre: se interna
+					id=nombresUsuario.size();
+					idsUsuario.insertar(userName,id);
+					nombresUsuario.push_back(userName);
+					posicionConectado.push_back(-1);
+					salaUsuario.push_back(-1);
+					posicionEnSala.push_back(-1);
+				}
+				else if(posicionConectado[id]!=-1)
+					return -1;
+				idUsuario=id;
+				posicionConectado[idUsuario]=entrando;
+			}
+			for(const conectado_t &c : conectados){
+				if(c.idUsuario>=anunciado.size() || !anunciado[c.idUsuario]){
+					ids.push_back(c.idUsuario);
+					nombres.push_back(nombresUsuario[c.idUsuario]);
+				}
+			}
+			if(!primero && ids.empty()){
+				destinos=conectados;
+				posicionConectado[idUsuario]=conectados.size();
+				conectados.push_back({idUsuario,clientID,versionAcordada,comprime});
+				entraEnSala(conectados.back(),salaGeneral);
+				break;
+			}
+		}
+
+		//la primera vez en version, con su propio nombre y el ack al final;
+		//lo que falte después ya va en la versión acordada
+		int v=primero ? version : versionAcordada;
+		vector<vector<unsigned char>> anuncios(ids.size()+1);
+		FrameBatch lote;
+		for(size_t i=0;i<ids.size();i++){
+			anuncios[i]=empaquetaUsuario(ids[i],nombres[i],v);
+			lote.addFrame(anuncios[i].data(),anuncios[i].size(),v);
+			if(ids[i]>=anunciado.size())
+				anunciado.resize(ids[i]+1);
+			anunciado[ids[i]]=true;
+		}
+		if(primero){
+			anuncios.back()=empaquetaUsuario(idUsuario,userName,v);
+			lote.addFrame(anuncios.back().data(),anuncios.back().size(),v);
+			lote.addFrame(ackLogin.data(),ackLogin.size(),v);
+		}
+		lote.flush(clientID);
+		primero=false;
+	}
+
+	//los demás solo necesitan el nuevo nombre, empaquetado una vez por versión
+	Difusion anuncio([&](int v){ return empaquetaUsuario(idUsuario,userName,v); });
+	for(const conectado_t &destino : destinos)
+		anuncio.envia(destino);
+	return idUsuario;
+}
+
+void clientManager::eliminaUsuario(unsigned int idUsuario)
+{
+	unique_lock<shared_mutex> lock(cerrojoUsuarios);
+	int pos=posicionConectado[idUsuario];
+	if(pos<0)
+		return;
+	//el último ocupa el hueco para que el array siga compacto
+	conectados[pos]=conectados.back();
+	posicionConectado[conectados[pos].idUsuario]=pos;
+	conectados.pop_back();
+	posicionConectado[idUsuario]=-1;
+	saleDeSala(idUsuario);
+}
+
+unsigned int clientManager::obtieneSala(string_view nombre)
+{
+	if(nombre.empty())
+		return salaGeneral;
+	{
+		shared_lock<shared_mutex> lock(cerrojoUsuarios);
+		int sala=idsSala.buscar(nombre);
+		if(sala>=0)
+			return sala;
+	}
+	unique_lock<shared_mutex> lock(cerrojoUsuarios);
+	int sala=idsSala.buscar(nombre);
+	if(sala<0){
+		//sala nueva: se interna
+		sala=nombresSala.size();
+		idsSala.insertar(nombre,sala);
+		nombresSala.emplace_back(nombre);
+		miembrosSala.emplace_back();
+	}
+	return sala;
+}
+
+void clientManager::cambiaSala(unsigned int idUsuario, unsigned int sala)
+{
+	unique_lock<shared_mutex> lock(cerrojoUsuarios);
+	int pos=posicionConectado[idUsuario];
+	if(pos<0 || salaUsuario[idUsuario]==(int)sala)
+		return;
+	saleDeSala(idUsuario);
+	entraEnSala(conectados[pos],sala);
+}
+
+void clientManager::entraEnSala(const conectado_t &usuario, unsigned int sala)
+{
+	salaUsuario[usuario.idUsuario]=sala;
+	posicionEnSala[usuario.idUsuario]=miembrosSala[sala].size();
+	miembrosSala[sala].push_back(usuario);
+}
+
+void clientManager::saleDeSala(unsigned int idUsuario)
+{
+	int sala=salaUsuario[idUsuario];
+	if(sala<0)
+		return;
+	//como en conectados, el último ocupa el hueco
+	vector<conectado_t> &miembros=miembrosSala[sala];
+	int pos=posicionEnSala[idUsuario];
+	miembros[pos]=miembros.back();
+	posicionEnSala[miembros[pos].idUsuario]=pos;
+	miembros.pop_back();
+	salaUsuario[idUsuario]=-1;
+	posicionEnSala[idUsuario]=-1;
+}
+
+void clientManager::reenviaTexto(unsigned int idUsuario, string_view msg)
+{
+	//empaquetar (y comprimir) mensaje una sola vez por formato, el mismo
+	//buffer sirve para todos los clientes que lo usan
+	Difusion bufferOut([&](int v){ return empaquetaTexto(idUsuario,msg,v); });
+
+	//copia de los miembros de la sala del emisor: los envíos bloquean y no
+	//deben hacerse con el cerrojo tomado. El vector se reutiliza entre
+	//mensajes del mismo hilo
+	static thread_local vector<conectado_t> miembros;
+	{
+		shared_lock<shared_mutex> lock(cerrojoUsuarios);
+		int sala=salaUsuario[idUsuario];
+		if(sala<0)
+			return;
+		miembros.assign(miembrosSala[sala].begin(),miembrosSala[sala].end());
+	}
+	//por cada cliente de la sala del emisor
+	for(const conectado_t &client : miembros){
 		//reenviar paquete
 			//si no soy el emisor
-		if(client.first!=userName)
-			sendMSG(client.second,bufferOut);
+		if(client.idUsuario!=idUsuario)
+			bufferOut.envia(client);
 	}
-	bufferOut.clear();//opcional
 
 }
 
+void clientManager::reenviaPrivado(unsigned int idUsuario, string_view destino, string_view msg)
+{
+	//nombre -> ID -> conexión, con el cerrojo solo para la búsqueda
+	conectado_t client;
+	{
+		shared_lock<shared_mutex> lock(cerrojoUsuarios);
+		int id=idsUsuario.buscar(destino);
+		if(id<0 || posicionConectado[id]<0)
+			return; //no existe o no está conectado: se descarta
+		client=conectados[posicionConectado[id]];
+	}
+	Difusion bufferOut([&](int v){ return empaquetaTexto(idUsuario,msg,v,privado); });
+	bufferOut.envia(client);
+}
+
+vector<unsigned char> clientManager::empaquetaTexto(unsigned int idUsuario, string_view msg, int version,
+                                                    msgTypes type)
+{
+	vector<unsigned char> bufferOut;
+	PacketWriter writer(bufferOut,sizeof(msgTypes)+sizeof(idUsuario)+sizeof(long int)+msg.size());
+	escribeTipo(writer,type,version); //tipo
+	escribeEntero(writer,idUsuario,version);
+	escribeCuerpo(writer,msg,version);
+	return bufferOut;
+}
+
+vector<unsigned char> clientManager::empaquetaUsuario(unsigned int idUsuario, string_view userName, int version)
+{
+	vector<unsigned char> bufferOut;
+	PacketWriter writer(bufferOut,sizeof(msgTypes)+sizeof(idUsuario)+sizeof(long int)+userName.size());
+	escribeTipo(writer,usuario,version);
+	escribeEntero(writer,idUsuario,version);
+	escribeCadena(writer,userName,version);
+	return bufferOut;
+}
+
 string clientManager::recibeMensaje(int serverId){
 
 	//recibir mensaje
 	string userName;
 	string mensaje;
-    vector<unsigned char> buffer;
-
-	recvMSG(serverId,buffer);
-	//desempaquetar mensaje reenviado
-		//desepaquetar tipo
-	msgTypes type=unpack<msgTypes>(buffer);
-		//username
-	userName=desempaquetaTipoTexto(buffer);
-		//mensaje
-	mensaje=desempaquetaTipoTexto(buffer);
-
-	return userName+":"+mensaje;
+
+	PacketReader reader(nullptr,0);
+	while(recvFrame(serverId,reader)){
+		//una trama mal formada deja el flujo sin sincronizar: se da el
+		//servidor por desconectado
+		try{
+			int version=versionProtocolo;
+			//desempaquetar mensaje reenviado
+				//desepaquetar tipo
+			msgTypes type=leeTipo(reader,version);
+			if(type==ack){
+				//confirmación de envíos: se atiende y se sigue esperando texto
+				unsigned int seq=leeEntero(reader,version);
+				if(version==PROTOCOL_V1 && reader.remaining()>=sizeof(unsigned int)){
+					//ack del login con la versión acordada: se activa antes de
+					//leer la siguiente trama y de despertar a enviaLogin
+					int acordada=reader.read<unsigned int>();
+					if(reader.remaining()>=sizeof(unsigned int))
+						compresion=acordada>=PROTOCOL_V2 && (reader.read<unsigned int>()&capacidadLZ);
+					setProtocolVersion(serverId,acordada);
+					versionProtocolo=acordada;
+				}
+				procesaAck(seq);
+				continue;
+			}
+			if(type==usuario){
+				//anuncio de un nombre: se guarda por ID
+				unsigned int idUsuario=leeEntero(reader,version);
+				if(idUsuario>=nombresRemotos.size())
+					nombresRemotos.resize(idUsuario+1);
+				nombresRemotos[idUsuario]=leeCadena(reader,version);
+				continue;
+			}
+			if(type!=texto && type!=privado){
+				ERRLOG ("tipo mensaje no válido");
+				continue;
+			}
+				//username a partir del ID
+			unsigned int idUsuario=leeEntero(reader,version);
+			if(idUsuario<nombresRemotos.size())
+				userName=nombresRemotos[idUsuario];
+			else
+				userName="#"+to_string(idUsuario);
+				//mensaje
+			mensaje=leeCuerpo(reader,version);
+
+			if(type==privado)
+				return userName+" (privado):"+mensaje;
+			return userName+":"+mensaje;
+		}
+		catch(const out_of_range&){
+			ERRLOG ("trama mal formada");
+			break;
+		}
+	}
+
+	//servidor desconectado: despertar a quien espere acks
+	{
+		lock_guard<mutex> lock(cerrojoBuffers);
+		desconectado=true;
+	}
+	cvAcks.notify_all();
+	return "";
 
 }//recibir un mensaje
\ No newline at end of file
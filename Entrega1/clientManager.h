@@ -1,8 +1,13 @@
 #include "utils.h"
+#include "tablaHash.h"
 #include <iostream>
 #include <string>
 #include <map>
 #include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
+#include <atomic>
 
 #define ERRLOG(msg) cout<<"Error "<<__FILE__<<":"<<__LINE__<<" "<<msg<<" \n"
 
@@ -17,22 +22,150 @@ public:
 		texto=0,
 		exit=1,
 		login=2,
-		ack=3
+		ack=3,
+		usuario=4,	//anuncio ID->nombre: [usuario][ID][nombre]
+		unirse=5,	//[unirse][seq][sala]: pasa a esa sala, creándola si no existe
+		abandonar=6,	//[abandonar][seq]: vuelve a la sala general
+		privado=7	//[privado][seq][destino][texto] al servidor, [privado][ID][texto] al destino
 	}msgTypes;
 
 	//variable de cierre de programa:
 	static inline bool cierreDePrograma=false;
 	//recepción asincrona de paquetes en cliente
 	static inline mutex cerrojoBuffers;
-	static inline vector<unsigned char> bufferAcks;
 	static inline vector<unsigned char> bufferTxt;
 
-	static inline map<string,int> connectionIds;
+	//ventana de envíos: los mensajes llevan secuencia y se envían sin esperar
+	//mientras haya menos de ventanaEnvio sin confirmar. El servidor responde
+	//con acks acumulativos que recibeMensaje entrega a procesaAck
+	static inline mutex cerrojoEnvio;
+	static inline condition_variable cvAcks;
+	static inline unsigned int ventanaEnvio=64;
+	static inline unsigned int ultimaSecuencia=0; //última enviada
+	static inline unsigned int ultimoAck=0;       //última confirmada
+	static inline bool desconectado=false;
+
+	//versión del protocolo (ver utils.h). Todo empieza en v1; el login
+	//ofrece la más alta del cliente como campo final y el ack del login
+	//devuelve la acordada, así un extremo antiguo ignora ese campo y se
+	//queda en v1
+	static inline atomic<int> versionProtocolo{PROTOCOL_V1}; //en el cliente
+	static inline int versionOfrecida=PROTOCOL_V2;
+	static inline int versionServidor=PROTOCOL_V2;
+	//capacidades opcionales, negociadas igual justo después de la versión.
+	//capacidadLZ: tramas v2 grandes comprimidas (FRAME_LZ en utils.h)
+	static const unsigned int capacidadLZ=1;
+	static inline unsigned int capacidadesOfrecidas=capacidadLZ;
+	static inline unsigned int capacidadesServidor=capacidadLZ;
+	static inline atomic<bool> compresion{false}; //en el cliente, ya acordada
+
+	//usuarios del servidor: cada nombre recibe en su primer login un ID
+	//entero fijo y los mensajes reenviados llevan solo ese ID
+	static inline shared_mutex cerrojoUsuarios;
+	static inline TablaHash idsUsuario;                //nombre -> ID
+	static inline vector<string> nombresUsuario;       //ID -> nombre
+	static inline vector<int> posicionConectado;       //ID -> índice en conectados, -1 o entrando
+	static const int entrando=-2;                      //login en curso (registraUsuario)
+	struct conectado_t{
+		unsigned int idUsuario;
+		int clientID;
+		int version;	//formato de las tramas hacia esa conexión
+		bool comprime;	//acordó capacidadLZ
+	};
+	static inline vector<conectado_t> conectados;      //todos, para anunciar nombres
+	//salas: cada usuario está en una (al entrar, la general) y sus textos solo
+	//se reenvían a los de su sala, así el coste depende del tamaño de la sala.
+	//Los nombres se internan como los de usuario
+	static const unsigned int salaGeneral=0;
+	static inline TablaHash idsSala=[](){ TablaHash t; t.insertar("general",salaGeneral); return t; }();
+	static inline vector<string> nombresSala{"general"};
+	static inline vector<vector<conectado_t>> miembrosSala=vector<vector<conectado_t>>(1); //array compacto por sala
+	static inline vector<int> salaUsuario;             //ID -> sala o -1
+	static inline vector<int> posicionEnSala;          //ID -> índice en miembrosSala[sala]
+	//en el cliente: nombres anunciados por el servidor, por ID
+	static inline vector<string> nombresRemotos;
+
 	static void enviaMensaje(int id, string mensaje);
-	static string desempaquetaTipoTexto(vector<unsigned char> &buffer);
+	static void enviaUnirse(int id, string sala);
+	static void enviaAbandonar(int id);
+	static void enviaPrivado(int id, string destino, string mensaje);
+	//petición con secuencia y un texto como último campo (texto, unirse...);
+	//un privado lleva antes el nombre del destino
+	static void enviaPeticion(int id, msgTypes type, string_view cuerpo, string_view destino="");
+	static string_view desempaquetaTipoTexto(PacketReader &reader);
 	static void enviaLogin(int id, string userName);
 	static void atiendeCliente(int clientId);
 	static string recibeMensaje(int serverId);
-	static void reenviaTexto(string userName, string msg);
+	static void configuraVentana(unsigned int ventana);
+	//bloquea hasta que seq esté confirmada (false si se perdió la conexión)
+	static bool esperaAck(unsigned int seq);
+	static void procesaAck(unsigned int seq);
+	static unsigned int reservaSecuencia();
+	//da de alta la conexión del usuario y anuncia su ID a los demás (y los
+	//de los demás a él). Los nombres y ackLogin le llegan en version antes
+	//del alta; después se le escribe en versionAcordada, comprimiendo si
+	//comprime. Ningún envío se hace con cerrojoUsuarios tomado.
+	//Devuelve el ID o -1 si ese nombre ya está conectado
+	static int registraUsuario(const string &userName, int clientID,
+	                           vector<unsigned char> &ackLogin, int version, int versionAcordada,
+	                           bool comprime);
+	static void eliminaUsuario(unsigned int idUsuario);
+	//ID de la sala con ese nombre (vacío: la general), creándola si no existe
+	static unsigned int obtieneSala(string_view nombre);
+	static void cambiaSala(unsigned int idUsuario, unsigned int sala);
+	//alta y baja en el array de una sala; requieren cerrojoUsuarios exclusivo
+	static void entraEnSala(const conectado_t &usuario, unsigned int sala);
+	static void saleDeSala(unsigned int idUsuario);
+	static void reenviaTexto(unsigned int idUsuario, string_view msg);
+	//solo a la conexión del usuario destino, sin recorrer conectados
+	static void reenviaPrivado(unsigned int idUsuario, string_view destino, string_view msg);
+	//paquete de texto reenviado: tipo, ID del usuario y mensaje
+	static vector<unsigned char> empaquetaTexto(unsigned int idUsuario, string_view msg, int version=PROTOCOL_V1,
+	                                            msgTypes type=texto);
+	static vector<unsigned char> empaquetaUsuario(unsigned int idUsuario, string_view userName, int version=PROTOCOL_V1);
+	//ack de seq; versionAcordada>0 la añade al final (respuesta a un login)
+	static vector<unsigned char> empaquetaAck(unsigned int seq, int version, int versionAcordada,
+	                                          int capacidadesAcordadas=-1);
+
+	//un mismo mensaje para varias conexiones: se empaqueta como mucho una
+	//vez por versión (empaqueta(version)) y se comprime una sola vez para
+	//todas las que acordaron compresión
+	template<typename Empaqueta>
+	class Difusion{
+	public:
+		Difusion(Empaqueta empaqueta):empaqueta(empaqueta),estadoComprimido(0){}
+
+		bool envia(const conectado_t &destino)
+		{
+			vector<unsigned char> &paquete=paquetes[destino.version];
+			if(paquete.empty())
+				paquete=empaqueta(destino.version);
+			if(destino.comprime){
+				if(estadoComprimido==0)
+					estadoComprimido=compressFrame(paquete,comprimido) ? 1 : -1;
+				if(estadoComprimido>0)
+					return sendFrame(destino.clientID,comprimido,PROTOCOL_V2,FRAME_LZ);
+			}
+			return sendFrame(destino.clientID,paquete,destino.version);
+		}
+
+	private:
+		Empaqueta empaqueta;
+		vector<unsigned char> paquetes[PROTOCOL_V2+1];
+		vector<unsigned char> comprimido;
+		int estadoComprimido; //0 sin intentar, 1 comprimido, -1 no compensa
+	};
+
+	//campos en el formato de cada versión: en v1 tipo int, enteros de 4
+	//bytes y cadenas con long int delante; en v2 tipo de 1 byte y enteros y
+	//longitudes varint. El cuerpo de un texto v2 ocupa el resto de la trama
+	static void escribeTipo(PacketWriter &writer, msgTypes type, int version);
+	static void escribeEntero(PacketWriter &writer, unsigned int value, int version);
+	static void escribeCadena(PacketWriter &writer, string_view str, int version);
+	static void escribeCuerpo(PacketWriter &writer, string_view str, int version);
+	static msgTypes leeTipo(PacketReader &reader, int version);
+	static unsigned int leeEntero(PacketReader &reader, int version);
+	static string_view leeCadena(PacketReader &reader, int version);
+	static string_view leeCuerpo(PacketReader &reader, int version);
 
 };
\ No newline at end of file
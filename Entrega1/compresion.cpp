@@ -0,0 +1,188 @@
+#include "compresion.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+const size_t MIN_COPIA = 4;
+const size_t MAX_DISTANCIA = 65535;
+const int BITS_HASH = 12;
+
+inline uint32_t lee32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - BITS_HASH);
+}
+
+// Longitud en nibble del token y, si no cabe, bytes de 255 más el resto
+inline void escribeLongitud(unsigned char*& out, size_t longitud) {
+    longitud -= 15;
+    while (longitud >= 255) {
+        *out++ = 255;
+        longitud -= 255;
+    }
+    *out++ = (unsigned char)longitud;
+}
+
+inline bool leeLongitud(const unsigned char*& p, const unsigned char* fin, size_t& longitud) {
+    unsigned char byte;
+    do {
+        if (p == fin) {
+            return false;
+        }
+        byte = *p++;
+        longitud += byte;
+    } while (byte == 255);
+    return true;
+}
+
+unsigned char* escribeSecuencia(unsigned char* out, const unsigned char* literales,
+                                size_t numLiterales, size_t distancia, size_t copia) {
+    unsigned char* token = out++;
+    size_t extraCopia = copia ? copia - MIN_COPIA : 0;
+    *token = (unsigned char)((numLiterales < 15 ? numLiterales : 15) << 4 |
+                             (extraCopia < 15 ? extraCopia : 15));
+    if (numLiterales >= 15) {
+        escribeLongitud(out, numLiterales);
+    }
+    memcpy(out, literales, numLiterales);
+    out += numLiterales;
+    if (copia) {
+        *out++ = (unsigned char)(distancia & 0xff);
+        *out++ = (unsigned char)(distancia >> 8);
+        if (extraCopia >= 15) {
+            escribeLongitud(out, extraCopia);
+        }
+    }
+    return out;
+}
+
+}
+
+bool comprimirLZ(const unsigned char* datos, size_t tamano, std::vector<unsigned char>& salida) {
+    if (tamano == 0) {
+        return false;
+    }
+
+    // Peor caso: tamaño, todo literales y un byte extra por cada 255
+    size_t inicio = salida.size();
+    salida.resize(inicio + tamano + tamano / 255 + 16);
+    unsigned char* out = salida.data() + inicio;
+
+    uint64_t v = tamano;
+    while (v >= 0x80) {
+        *out++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *out++ = (unsigned char)v;
+
+    // Posición + 1 de los últimos 4 bytes con cada hash (0: ninguna)
+    uint32_t tabla[1 << BITS_HASH];
+    memset(tabla, 0, sizeof(tabla));
+
+    size_t ancla = 0;
+    size_t i = 0;
+    while (i + MIN_COPIA <= tamano) {
+        uint32_t grupo = lee32(datos + i);
+        uint32_t& entrada = tabla[hash4(grupo)];
+        size_t candidata = entrada;
+        entrada = (uint32_t)(i + 1);
+        if (candidata == 0 || i - (candidata - 1) > MAX_DISTANCIA ||
+            lee32(datos + candidata - 1) != grupo) {
+            ++i;
+            continue;
+        }
+
+        size_t referencia = candidata - 1;
+        size_t copia = MIN_COPIA;
+        while (i + copia < tamano && datos[referencia + copia] == datos[i + copia]) {
+            ++copia;
+        }
+        out = escribeSecuencia(out, datos + ancla, i - ancla, i - referencia, copia);
+        i += copia;
+        ancla = i;
+    }
+    out = escribeSecuencia(out, datos + ancla, tamano - ancla, 0, 0);
+
+    size_t comprimido = out - (salida.data() + inicio);
+    if (comprimido >= tamano) {
+        salida.resize(inicio);
+        return false;
+    }
+    salida.resize(inicio + comprimido);
+    return true;
+}
+
+bool descomprimirLZ(const unsigned char* datos, size_t tamano, std::vector<unsigned char>& salida,
+                    size_t maximo) {
+    const unsigned char* p = datos;
+    const unsigned char* fin = datos + tamano;
+
+    uint64_t original = 0;
+    for (int desplazamiento = 0;; desplazamiento += 7) {
+        if (p == fin || desplazamiento >= 64) {
+            return false;
+        }
+        unsigned char byte = *p++;
+        original |= (uint64_t)(byte & 0x7f) << desplazamiento;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    if (original > maximo) {
+        return false;
+    }
+
+    salida.resize(original);
+    unsigned char* out = salida.data();
+    size_t escrito = 0;
+    while (p < fin) {
+        unsigned char token = *p++;
+
+        size_t numLiterales = token >> 4;
+        if (numLiterales == 15 && !leeLongitud(p, fin, numLiterales)) {
+            return false;
+        }
+        if ((size_t)(fin - p) < numLiterales || original - escrito < numLiterales) {
+            return false;
+        }
+        memcpy(out + escrito, p, numLiterales);
+        p += numLiterales;
+        escrito += numLiterales;
+        if (p == fin) {
+            break;
+        }
+
+        if (fin - p < 2) {
+            return false;
+        }
+        size_t distancia = p[0] | (size_t)p[1] << 8;
+        p += 2;
+        size_t copia = token & 0x0f;
+        if (copia == 15 && !leeLongitud(p, fin, copia)) {
+            return false;
+        }
+        copia += MIN_COPIA;
+        if (distancia == 0 || distancia > escrito || original - escrito < copia) {
+            return false;
+        }
+
+        // Con solapamiento (distancia < copia) se repite el patrón byte a byte
+        unsigned char* destino = out + escrito;
+        const unsigned char* origen = destino - distancia;
+        if (distancia >= copia) {
+            memcpy(destino, origen, copia);
+        } else {
+            for (size_t k = 0; k < copia; ++k) {
+                destino[k] = origen[k];
+            }
+        }
+        escrito += copia;
+    }
+    return escrito == original;
+}
@@ -0,0 +1,32 @@
+/*
+ * compresion.h - Compresor LZ sencillo para las tramas grandes
+ *
+ * Formato de la familia LZ77, parecido al bloque de LZ4: la salida empieza
+ * por el tamaño original en varint y sigue con secuencias de
+ *   [token][longitud extra de literales][literales][distancia 2 bytes][longitud extra de copia]
+ * El token lleva en el nibble alto cuántos literales hay y en el bajo la
+ * longitud de la copia menos MIN_COPIA; el valor 15 indica que siguen bytes
+ * de 255 más un resto. La última secuencia solo tiene literales.
+ *
+ * Las coincidencias se buscan con una tabla hash de la posición más reciente
+ * de cada grupo de 4 bytes: una pasada, sin reservas de memoria aparte de la
+ * salida. Está pensado para texto (logs, trazas pegadas en el chat), donde
+ * las líneas repiten mucho, no para ganar a un compresor de entropía.
+ */
+
+#ifndef _COMPRESION_H_
+#define _COMPRESION_H_
+
+#include <cstddef>
+#include <vector>
+
+// Añade a salida la versión comprimida de datos. false (y salida como
+// estaba) si no ocupa menos que el original
+bool comprimirLZ(const unsigned char* datos, size_t tamano, std::vector<unsigned char>& salida);
+
+// Sustituye salida por los datos originales. false si la entrada no es
+// válida o el tamaño original supera maximo
+bool descomprimirLZ(const unsigned char* datos, size_t tamano, std::vector<unsigned char>& salida,
+                    size_t maximo);
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * ejecutor.cpp - Implementación del pool con robo de trabajo
+ *
+ * pendientes cuenta las tareas encoladas. Un hilo solo duerme si es cero
+ * comprobándolo bajo esperaMutex, y enviar toma el mismo mutex antes de
+ * avisar, así que ninguna tarea se queda sin hilo que la vea.
+ */
+
+#include "ejecutor.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+// Hilo del pool que está ejecutando este código (nullptr fuera del pool)
+static thread_local Ejecutor* ejecutorActual = nullptr;
+static thread_local int indiceActual = -1;
+
+Ejecutor::Ejecutor(int numHilos, bool fijarCpu)
+    : pendientes(0), siguiente(0), salir(false) {
+    if (numHilos <= 0) {
+        numHilos = std::thread::hardware_concurrency();
+        if (numHilos <= 0) {
+            numHilos = 1;
+        }
+    }
+    for (int i = 0; i < numHilos; ++i) {
+        colas.emplace_back(new Cola());
+    }
+    // Las colas existen antes de arrancar ningún hilo: se pueden robar ya
+    for (int i = 0; i < numHilos; ++i) {
+        hilos.emplace_back(&Ejecutor::bucle, this, i, fijarCpu);
+    }
+}
+
+Ejecutor::~Ejecutor() {
+    {
+        std::lock_guard<std::mutex> lock(esperaMutex);
+        salir = true;
+    }
+    hayTareas.notify_all();
+    for (std::thread& hilo : hilos) {
+        hilo.join();
+    }
+}
+
+void Ejecutor::enviar(std::function<void()> tarea) {
+    int indice;
+    if (ejecutorActual == this) {
+        indice = indiceActual;
+    } else {
+        indice = siguiente.fetch_add(1, std::memory_order_relaxed) % colas.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(colas[indice]->cerrojo);
+        colas[indice]->tareas.push_back(std::move(tarea));
+    }
+    pendientes.fetch_add(1);
+
+    {
+        std::lock_guard<std::mutex> lock(esperaMutex);
+    }
+    hayTareas.notify_one();
+}
+
+// Primero la cola propia por el final; si está vacía se roba por el
+// principio de las demás, empezando por la siguiente
+bool Ejecutor::obtener(int indice, std::function<void()>& tarea) {
+    {
+        Cola& propia = *colas[indice];
+        std::lock_guard<std::mutex> lock(propia.cerrojo);
+        if (!propia.tareas.empty()) {
+            tarea = std::move(propia.tareas.back());
+            propia.tareas.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < colas.size(); ++i) {
+        Cola& victima = *colas[(indice + i) % colas.size()];
+        std::lock_guard<std::mutex> lock(victima.cerrojo);
+        if (!victima.tareas.empty()) {
+            tarea = std::move(victima.tareas.front());
+            victima.tareas.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Ejecutor::bucle(int indice, bool fijarCpu) {
+    ejecutorActual = this;
+    indiceActual = indice;
+
+    if (fijarCpu) {
+        int numCpus = std::thread::hardware_concurrency();
+        if (numCpus > 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(indice % numCpus, &cpus);
+            pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        }
+    }
+
+    std::function<void()> tarea;
+    while (true) {
+        if (obtener(indice, tarea)) {
+            pendientes.fetch_sub(1);
+            tarea();
+            tarea = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(esperaMutex);
+        hayTareas.wait(lock, [this]() {
+            return salir || pendientes.load() > 0;
+        });
+        if (salir && pendientes.load() == 0) {
+            return;
+        }
+    }
+}
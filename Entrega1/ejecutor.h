@@ -0,0 +1,66 @@
+/*
+ * ejecutor.h - Pool de hilos con robo de trabajo para atender conexiones
+ *
+ * Un número fijo de hilos ejecuta tareas cortas (atender una conexión,
+ * procesar un mensaje) en vez de crear un hilo por cliente. Cada hilo tiene
+ * su propia cola: las tareas que envía un hilo del pool van a su cola y las
+ * saca él mismo por el final (LIFO, datos aún en caché); las que llegan de
+ * fuera se reparten por turnos. Un hilo sin trabajo roba por el principio
+ * de la cola de otro antes de dormir.
+ *
+ * Las tareas no deben bloquearse indefinidamente: una tarea que espera a un
+ * socket ocupa su hilo mientras tanto, así que el número de hilos limita las
+ * tareas bloqueantes simultáneas.
+ */
+
+#ifndef _EJECUTOR_H_
+#define _EJECUTOR_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Ejecutor {
+
+public:
+    // numHilos 0: uno por CPU. Con fijarCpu cada hilo se ata a la CPU
+    // (índice % CPUs) para que sus colas y datos no cambien de núcleo
+    explicit Ejecutor(int numHilos = 0, bool fijarCpu = false);
+
+    // Ejecuta las tareas pendientes y espera a los hilos
+    ~Ejecutor();
+
+    Ejecutor(const Ejecutor&) = delete;
+    Ejecutor& operator=(const Ejecutor&) = delete;
+
+    void enviar(std::function<void()> tarea);
+
+    int numHilos() const { return hilos.size(); }
+
+private:
+    // Cola de un hilo, cada una en su propia línea de caché
+    struct Cola {
+        std::mutex cerrojo;
+        std::deque<std::function<void()>> tareas;
+        char relleno[64];
+    };
+
+    void bucle(int indice, bool fijarCpu);
+    bool obtener(int indice, std::function<void()>& tarea);
+
+    std::vector<std::unique_ptr<Cola>> colas;
+    std::vector<std::thread> hilos;
+    std::atomic<long> pendientes;         // Tareas encoladas sin empezar
+    std::atomic<unsigned> siguiente;      // Reparto por turnos desde fuera
+
+    std::mutex esperaMutex;
+    std::condition_variable hayTareas;
+    bool salir;
+};
+
+#endif
@@ -0,0 +1,309 @@
+/*
+ * pack_bench.cpp - Microbenchmarks de pack/packv/unpack/unpackv, de
+ *                  PacketWriter/PacketReader y de los mensajes de la bandeja
+ *                  de entrada (utils.h)
+ *
+ * Cada caso se repite hasta superar un tiempo mínimo y se muestra:
+ *   ns/op      tiempo medio de una operación
+ *   MB/s       bytes de carga útil procesados por segundo
+ *   allocs/op  llamadas a operator new por operación
+ *
+ * Una operación es empaquetar o desempaquetar la carga completa:
+ *   pack     un pack por elemento sobre un vector nuevo
+ *   packv    un packv con todos los elementos sobre un vector nuevo (una copia)
+ *   unpack   un unpack por elemento avanzando el offset de lectura
+ *   unpackv  un unpackv con todos los elementos
+ *   write    un PacketWriter::write por elemento, capacidad reservada al inicio
+ *   read     un PacketReader::read por elemento sobre el paquete sin copiarlo
+ *   texto    clientManager::empaquetaTexto / decodificación como recibeMensaje
+ *            (>pack2 y >unpack2 con el formato del protocolo v2)
+ *   mensaje  guardar una trama recibida como msg_t y liberarla, tipo:
+ *              new   msg_t y datos con new[] (como hacía recvMSGAsync)
+ *              pool  allocMSG/freeMSG sobre el pool de bloques
+ *   bandeja  una trama escrita en un socketpair, recibida por recvMSGAsync en
+ *            su hilo y sacada con waitMSG/freeMSG (allocs/op de los dos hilos)
+ *   lz       comprimirLZ / descomprimirLZ de texto tipo log; al final de cada
+ *            tamaño se muestra la razón de compresión
+ *
+ * Uso: ./pack_bench [tiempo mínimo por caso en ms, por defecto 200]
+ */
+
+#include "utils.h"
+#include "clientManager.h"
+#include "compresion.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <thread>
+
+using namespace std;
+
+//contador de reservas de memoria de todo el programa
+static atomic<unsigned long> numAllocs(0);
+
+void* operator new(size_t size)
+{
+	numAllocs.fetch_add(1,memory_order_relaxed);
+	void* ptr=malloc(size ? size : 1);
+	if(!ptr)
+		throw bad_alloc();
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+//impide que el compilador elimine el trabajo medido
+static inline void noOptimizar(const void* ptr)
+{
+	asm volatile("" : : "g"(ptr) : "memory");
+}
+
+static double tiempoMinimo=0.2;
+
+template<typename F>
+void medir(const char* caso, const char* tipo, size_t bytes, F op)
+{
+	typedef chrono::steady_clock reloj;
+
+	op(); //calentamiento
+
+	long iteraciones=1;
+	double segundos=0;
+	unsigned long allocs=0;
+	while(true)
+	{
+		unsigned long allocsInicio=numAllocs.load(memory_order_relaxed);
+		auto inicio=reloj::now();
+		for(long i=0;i<iteraciones;i++)
+			op();
+		segundos=chrono::duration<double>(reloj::now()-inicio).count();
+		allocs=numAllocs.load(memory_order_relaxed)-allocsInicio;
+		if(segundos>=tiempoMinimo)
+			break;
+		//estimar cuántas iteraciones hacen falta para llegar al mínimo
+		double factor=segundos>0 ? tiempoMinimo/segundos*1.2 : 10;
+		iteraciones=(long)(iteraciones*(factor<10 ? (factor>2 ? factor : 2) : 10));
+	}
+
+	double nsOp=segundos*1e9/iteraciones;
+	double mbs=bytes*iteraciones/segundos/1e6;
+	printf("%-8s %-8s %9zu %10ld %14.1f %10.1f %10.2f\n",
+	       caso,tipo,bytes,iteraciones,nsOp,mbs,(double)allocs/iteraciones);
+}
+
+template<typename T>
+void medirTipo(const char* tipo, size_t bytes)
+{
+	int n=bytes/sizeof(T);
+	vector<T> datos(n);
+	for(int i=0;i<n;i++)
+		datos[i]=(T)(i*7+1);
+
+	medir("pack",tipo,bytes,[&](){
+		vector<unsigned char> packet;
+		for(int i=0;i<n;i++)
+			pack(packet,datos[i]);
+		noOptimizar(packet.data());
+	});
+
+	medir("packv",tipo,bytes,[&](){
+		vector<unsigned char> packet;
+		packv(packet,datos.data(),n);
+		noOptimizar(packet.data());
+	});
+
+	vector<unsigned char> original;
+	packv(original,datos.data(),n);
+	vector<T> salida(n);
+
+	medir("unpack",tipo,bytes,[&](){
+		size_t offset=0;
+		for(int i=0;i<n;i++)
+			salida[i]=unpack<T>(original,offset);
+		noOptimizar(salida.data());
+	});
+
+	medir("unpackv",tipo,bytes,[&](){
+		size_t offset=0;
+		unpackv(original,offset,salida.data(),n);
+		noOptimizar(salida.data());
+	});
+
+	medir("write",tipo,bytes,[&](){
+		vector<unsigned char> packet;
+		PacketWriter writer(packet,bytes);
+		for(int i=0;i<n;i++)
+			writer.write(datos[i]);
+		noOptimizar(packet.data());
+	});
+
+	medir("read",tipo,bytes,[&](){
+		PacketReader reader(original);
+		for(int i=0;i<n;i++)
+			salida[i]=reader.read<T>();
+		noOptimizar(salida.data());
+	});
+}
+
+void medirTexto(size_t bytes)
+{
+	unsigned int idUsuario=17;
+	string mensaje(bytes,'m');
+
+	medir("texto",">pack",bytes,[&](){
+		vector<unsigned char> packet=clientManager::empaquetaTexto(idUsuario,mensaje);
+		noOptimizar(packet.data());
+	});
+
+	vector<unsigned char> original=clientManager::empaquetaTexto(idUsuario,mensaje);
+	medir("texto",">unpack",bytes,[&](){
+		PacketReader reader(original);
+		reader.read<clientManager::msgTypes>();
+		unsigned int u=reader.read<unsigned int>();
+		string m(clientManager::desempaquetaTipoTexto(reader));
+		noOptimizar(m.data());
+		noOptimizar(&u);
+	});
+
+	medir("texto",">pack2",bytes,[&](){
+		vector<unsigned char> packet=clientManager::empaquetaTexto(idUsuario,mensaje,PROTOCOL_V2);
+		noOptimizar(packet.data());
+	});
+
+	vector<unsigned char> original2=clientManager::empaquetaTexto(idUsuario,mensaje,PROTOCOL_V2);
+	medir("texto",">unpack2",bytes,[&](){
+		PacketReader reader(original2);
+		clientManager::leeTipo(reader,PROTOCOL_V2);
+		unsigned int u=clientManager::leeEntero(reader,PROTOCOL_V2);
+		string m(clientManager::leeCuerpo(reader,PROTOCOL_V2));
+		noOptimizar(m.data());
+		noOptimizar(&u);
+	});
+}
+
+void medirMensaje(size_t bytes)
+{
+	vector<unsigned char> trama(bytes,'t');
+
+	medir("mensaje","new",bytes,[&](){
+		msg_t* msg=new msg_t[1];
+		msg->data=new unsigned char[trama.size()];
+		memcpy(msg->data,trama.data(),trama.size());
+		msg->size=trama.size();
+		noOptimizar(msg->data);
+		delete[] msg->data;
+		delete[] msg;
+	});
+
+	medir("mensaje","pool",bytes,[&](){
+		msg_t* msg=allocMSG(trama.size());
+		memcpy(msg->data,trama.data(),trama.size());
+		noOptimizar(msg->data);
+		freeMSG(msg);
+	});
+}
+
+void medirBandeja(size_t bytes)
+{
+	int sv[2];
+	if(socketpair(AF_UNIX,SOCK_STREAM,0,sv)<0)
+		return;
+
+	//conexión registrada a mano sobre un extremo del socketpair
+	connection_t conexion;
+	int slot=clientList.reservar();
+	conexion.id=conexion.serverId=newConnectionID(slot);
+	conexion.socket=sv[0];
+	conexion.socketOwner=make_shared<SharedSocket>(sv[0]);
+	conexion.buffer=newInbox();
+	conexion.reader=make_shared<FrameReader>();
+	conexion.alive=true;
+	clientList.publicar(slot,conexion);
+	thread receptor(recvMSGAsync,conexion);
+
+	vector<unsigned char> trama(sizeof(int)+bytes,'b');
+	int tamano=bytes;
+	memcpy(trama.data(),&tamano,sizeof(int));
+
+	medir("bandeja","recv",bytes,[&](){
+		for(size_t enviado=0;enviado<trama.size();)
+			enviado+=write(sv[1],trama.data()+enviado,trama.size()-enviado);
+		msg_t* msg=waitMSG(conexion.id);
+		noOptimizar(msg->data);
+		freeMSG(msg);
+	});
+
+	close(sv[1]);
+	receptor.join();
+	closeConnection(conexion.id);
+}
+
+void medirCompresion(size_t bytes)
+{
+	//líneas de log parecidas pero no iguales, como las que se pegan en el chat
+	string texto;
+	char linea[160];
+	for(int i=0;texto.size()<bytes;i++)
+	{
+		snprintf(linea,sizeof(linea),"12:%02d:%02d INFO [worker-%d] peticion id=%d usuario=u%d estado=ok tiempo=%dms\n",
+		         i/60%60,i%60,i%8,1000+i*7,i%13,(i*37)%500);
+		texto+=linea;
+	}
+	texto.resize(bytes);
+	const unsigned char* datos=(const unsigned char*)texto.data();
+
+	vector<unsigned char> comprimido;
+	comprimido.reserve(2*bytes);
+	medir("lz","comp",bytes,[&](){
+		comprimido.clear();
+		comprimirLZ(datos,bytes,comprimido);
+		noOptimizar(comprimido.data());
+	});
+
+	//los textos muy cortos no se comprimen (la salida no sería menor)
+	comprimido.clear();
+	if(!comprimirLZ(datos,bytes,comprimido))
+		return;
+
+	vector<unsigned char> salida(bytes);
+	medir("lz","descomp",bytes,[&](){
+		descomprimirLZ(comprimido.data(),comprimido.size(),salida,bytes);
+		noOptimizar(salida.data());
+	});
+
+	printf("%-8s %-8s %9zu %10zu razón %.2f\n","lz","bytes",bytes,comprimido.size(),
+		       (double)bytes/comprimido.size());
+}
+
+int main(int argc,char** argv)
+{
+	if(argc>1)
+		tiempoMinimo=atoi(argv[1])/1000.0;
+
+	const size_t tamanos[]={64,1024,16*1024,256*1024};
+
+	printf("%-8s %-8s %9s %10s %14s %10s %10s\n",
+	       "caso","tipo","bytes","iter","ns/op","MB/s","allocs/op");
+	for(size_t bytes : tamanos)
+	{
+		medirTipo<char>("char",bytes);
+		medirTipo<int>("int",bytes);
+		medirTipo<double>("double",bytes);
+		medirTexto(bytes);
+		medirMensaje(bytes);
+		medirBandeja(bytes);
+		medirCompresion(bytes);
+	}
+	return 0;
+}
@@ -0,0 +1,57 @@
+#include "pool.h"
+
+PoolBloques::~PoolBloques() {
+    for (Clase& c : clases) {
+        for (char* slab : c.slabs) {
+            delete[] slab;
+        }
+    }
+}
+
+int PoolBloques::clase(size_t bytes) {
+    for (int i = 0; i < NUM_CLASES; ++i) {
+        if (bytes <= tamanoClase(i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void* PoolBloques::reservar(size_t bytes) {
+    int indice = clase(bytes);
+    if (indice < 0) {
+        return new char[bytes];
+    }
+
+    Clase& c = clases[indice];
+    std::lock_guard<std::mutex> lock(c.cerrojo);
+    if (c.libres.empty()) {
+        // Slab nuevo: todos sus bloques pasan a la lista de libres
+        size_t tamano = tamanoClase(indice);
+        size_t numBloques = TAM_SLAB / tamano;
+        if (numBloques < MIN_BLOQUES_SLAB) {
+            numBloques = MIN_BLOQUES_SLAB;
+        }
+        char* slab = new char[tamano * numBloques];
+        c.slabs.push_back(slab);
+        c.libres.reserve(c.slabs.size() * numBloques);
+        for (size_t i = 0; i < numBloques; ++i) {
+            c.libres.push_back(slab + i * tamano);
+        }
+    }
+    void* bloque = c.libres.back();
+    c.libres.pop_back();
+    return bloque;
+}
+
+void PoolBloques::liberar(void* bloque, size_t bytes) {
+    int indice = clase(bytes);
+    if (indice < 0) {
+        delete[] static_cast<char*>(bloque);
+        return;
+    }
+
+    Clase& c = clases[indice];
+    std::lock_guard<std::mutex> lock(c.cerrojo);
+    c.libres.push_back(bloque);
+}
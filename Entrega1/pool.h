@@ -0,0 +1,55 @@
+/*
+ * pool.h - Pool de bloques por clases de tamaño para los mensajes recibidos
+ *
+ * Cada clase (64 B, 256 B, ... 256 KiB) guarda una lista de bloques libres.
+ * Cuando se vacía se pide a new un slab de varios bloques a la vez y los
+ * bloques liberados vuelven a su lista en vez de a new/delete, así que en
+ * régimen estable reservar y liberar no tocan el montón. Los bloques
+ * mayores que la clase más grande van directamente a new/delete.
+ *
+ * Reserva y liberación pueden ocurrir en hilos distintos (el hilo receptor
+ * reserva y la aplicación libera): cada clase tiene su propio mutex.
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+class PoolBloques {
+
+public:
+    PoolBloques() {}
+    ~PoolBloques();
+
+    PoolBloques(const PoolBloques&) = delete;
+    PoolBloques& operator=(const PoolBloques&) = delete;
+
+    // Bloque de al menos bytes bytes (alineado como new)
+    void* reservar(size_t bytes);
+
+    // bytes debe ser el mismo valor pedido al reservar
+    void liberar(void* bloque, size_t bytes);
+
+private:
+    static const int NUM_CLASES = 7;
+    static const size_t TAM_SLAB = 256 * 1024;   // Bytes pedidos a new por slab
+    static const size_t MIN_BLOQUES_SLAB = 4;
+
+    struct Clase {
+        std::mutex cerrojo;
+        std::vector<void*> libres;
+        std::vector<char*> slabs;
+        char relleno[64];
+    };
+
+    // Clase para ese tamaño o -1 si es mayor que la más grande
+    static int clase(size_t bytes);
+    static size_t tamanoClase(int indice) { return size_t(64) << (2 * indice); }
+
+    Clase clases[NUM_CLASES];
+};
+
+#endif
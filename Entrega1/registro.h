@@ -0,0 +1,194 @@
+/*
+ * registro.h - Registro concurrente de conexiones con lectura sin cerrojos
+ *
+ * Cada elemento ocupa un slot de un array de capacidad fija. Los lectores
+ * (broadcast, listados, búsquedas por ID) recorren los slots leyendo punteros
+ * atómicos y nunca se bloquean. Las altas y bajas se serializan entre sí con
+ * un mutex y son O(1): el índice del slot es el identificador del elemento y
+ * los slots libres se reutilizan.
+ *
+ * Reclamación de memoria estilo RCU con dos contadores de lectores: al dar de
+ * baja un elemento se vacía su slot, se cambia de época y se espera a que
+ * terminen los lectores que entraron en la época anterior antes de liberarlo.
+ * Quien espera es siempre el que da de baja, nunca un lector.
+ */
+
+#ifndef _REGISTRO_H_
+#define _REGISTRO_H_
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+template<typename T>
+class Registro {
+
+public:
+    explicit Registro(size_t capacidad)
+        : slots(new std::atomic<T*>[capacidad]), capacidad(capacidad),
+          usados(0), numElementos(0), epoca(0), siguienteNuevo(0) {
+        for (size_t i = 0; i < capacidad; ++i) {
+            slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+        lectores[0].valor.store(0);
+        lectores[1].valor.store(0);
+    }
+
+    ~Registro() {
+        for (size_t i = 0; i < capacidad; ++i) {
+            delete slots[i].load(std::memory_order_relaxed);
+        }
+        delete[] slots;
+    }
+
+    Registro(const Registro&) = delete;
+    Registro& operator=(const Registro&) = delete;
+
+    // Reserva un slot libre. Devuelve -1 si el registro está lleno.
+    // El slot no es visible para los lectores hasta llamar a publicar
+    int reservar() {
+        std::lock_guard<std::mutex> lock(escrituraMutex);
+        if (!libres.empty()) {
+            int slot = libres.back();
+            libres.pop_back();
+            return slot;
+        }
+        if (siguienteNuevo >= capacidad) {
+            return -1;
+        }
+        return static_cast<int>(siguienteNuevo++);
+    }
+
+    // Hace visible un valor en un slot reservado
+    void publicar(int slot, const T& valor) {
+        std::lock_guard<std::mutex> lock(escrituraMutex);
+        slots[slot].store(new T(valor), std::memory_order_release);
+        if (static_cast<size_t>(slot) >= usados.load(std::memory_order_relaxed)) {
+            usados.store(slot + 1, std::memory_order_release);
+        }
+        numElementos.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // reservar + publicar. Devuelve el slot o -1 si está lleno
+    int insertar(const T& valor) {
+        int slot = reservar();
+        if (slot >= 0) {
+            publicar(slot, valor);
+        }
+        return slot;
+    }
+
+    // Da de baja el elemento de un slot en O(1). Cuando retorna ningún lector
+    // conserva una referencia a él. Devuelve false si el slot estaba vacío
+    bool eliminar(int slot) {
+        return eliminarSi(slot, [](const T&) { return true; });
+    }
+
+    // Como eliminar, pero solo si condicion(valor) se cumple. Se comprueba
+    // con las altas y bajas bloqueadas, así que el slot no puede haberse
+    // reutilizado para otro elemento entre la comprobación y la baja
+    template<typename F>
+    bool eliminarSi(int slot, F condicion) {
+        if (slot < 0 || static_cast<size_t>(slot) >= capacidad) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(escrituraMutex);
+        T* valor = slots[slot].load(std::memory_order_acquire);
+        if (valor == nullptr || !condicion(*valor)) {
+            return false;
+        }
+        slots[slot].store(nullptr, std::memory_order_release);
+        esperarLectores();
+        delete valor;
+        libres.push_back(slot);
+        numElementos.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Copia el valor de un slot. Devuelve false si está vacío
+    bool obtener(int slot, T& copia) const {
+        if (slot < 0 || static_cast<size_t>(slot) >= capacidad) {
+            return false;
+        }
+        Lectura lectura(*this);
+        T* valor = slots[slot].load(std::memory_order_acquire);
+        if (valor == nullptr) {
+            return false;
+        }
+        copia = *valor;
+        return true;
+    }
+
+    // Llama a f(slot, valor) para cada elemento sin tomar ningún cerrojo.
+    // Las referencias que recibe f solo son válidas durante la llamada
+    template<typename F>
+    void recorrer(F f) const {
+        Lectura lectura(*this);
+        size_t n = usados.load(std::memory_order_acquire);
+        for (size_t i = 0; i < n; ++i) {
+            T* valor = slots[i].load(std::memory_order_acquire);
+            if (valor != nullptr) {
+                f(static_cast<int>(i), *valor);
+            }
+        }
+    }
+
+    size_t size() const {
+        return numElementos.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Contador de lectores en su propia línea de caché (en C++17 new también
+    // respeta la alineación si el registro se crea en el heap)
+    struct alignas(64) ContadorLectores {
+        std::atomic<long> valor;
+    };
+
+    // Marca la duración de una lectura en el contador de la época actual
+    class Lectura {
+    public:
+        explicit Lectura(const Registro& registro) : registro(registro) {
+            while (true) {
+                paridad = registro.epoca.load() & 1;
+                registro.lectores[paridad].valor.fetch_add(1);
+                // Si la época cambió entre medias, quien da de baja puede no
+                // haber visto este lector: se reintenta en la nueva época
+                if ((registro.epoca.load() & 1) == paridad) {
+                    break;
+                }
+                registro.lectores[paridad].valor.fetch_sub(1);
+            }
+        }
+        ~Lectura() {
+            registro.lectores[paridad].valor.fetch_sub(1);
+        }
+    private:
+        const Registro& registro;
+        unsigned long paridad;
+    };
+
+    // Cambia de época y espera a los lectores de la anterior.
+    // Requiere escrituraMutex tomado
+    void esperarLectores() {
+        unsigned long anterior = epoca.fetch_add(1) & 1;
+        while (lectores[anterior].valor.load() != 0) {
+            std::this_thread::yield();
+        }
+    }
+
+    std::atomic<T*>* slots;
+    size_t capacidad;
+    std::atomic<size_t> usados;         // Los lectores solo miran slots < usados
+    std::atomic<size_t> numElementos;
+
+    alignas(64) mutable std::atomic<unsigned long> epoca;
+    mutable ContadorLectores lectores[2];
+
+    std::mutex escrituraMutex;          // Serializa altas y bajas
+    std::vector<int> libres;            // Slots reutilizables
+    size_t siguienteNuevo;              // Primer slot nunca usado
+};
+
+#endif
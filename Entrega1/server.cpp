@@ -1,43 +1,52 @@
 #include "utils.h"
+#include "ejecutor.h"
 #include <iostream>
 #include <string>
 #include <thread>
 #include <list>
+#include <sys/time.h>
 
 using namespace std;
 
+// Máximo que una tarea del pool espera los datos de un cliente. Sin límite,
+// tantos clientes callados como hilos tendrían parado el pool para siempre
+static int segundosEspera = 5;
+
 void atiendeConexion(int clientId)
 {
-    vector<unsigned char> buffer;
     string mensaje;
 
     cout << "Nuevo cliente conectado (ID: " << clientId << ")" << endl;
 
     // Verificar que el cliente existe en clientList
-    if(clientList.find(clientId) == clientList.end())
+    connection_t conexion=getConnection(clientId);
+    if(conexion.socket<0)
     {
         cout << "ERROR: Cliente " << clientId << " no encontrado en clientList" << endl;
         return;
     }
 
-    cout << "Socket del cliente: " << clientList[clientId].socket << endl;
+    cout << "Socket del cliente: " << conexion.socket << endl;
     cout << "Esperando datos del cliente..." << endl;
 
-    try {
-        recvMSG(clientId, buffer);
-
-        cout << "Datos recibidos, tamano del buffer: " << buffer.size() << " bytes" << endl;
+    struct timeval espera = {segundosEspera, 0};
+    setsockopt(conexion.socket, SOL_SOCKET, SO_RCVTIMEO, &espera, sizeof(espera));
 
-        if(buffer.size() == 0)
+    try {
+        // La trama se lee sobre el buffer de la conexión, sin copiarla
+        PacketReader reader(nullptr, 0);
+        if(!recvFrame(clientId, reader))
         {
-            cout << "Cliente desconectado antes de enviar datos" << endl;
+            cout << "Cliente desconectado o sin datos en " << segundosEspera << " s" << endl;
             closeConnection(clientId);
             return;
         }
 
-        mensaje.resize(unpack<int>(buffer));
+        cout << "Datos recibidos, tamano del buffer: " << reader.remaining() << " bytes" << endl;
 
-        unpackv<char>(buffer, (char*)mensaje.data(), mensaje.size());
+        // Leer tamaño y contenido
+        int tamano = reader.read<int>();
+        mensaje = reader.view(tamano);
 
         cout << "Mensaje recibido: \"" << mensaje << "\"" << endl;
 
@@ -51,8 +60,33 @@ void atiendeConexion(int clientId)
     }
 }
 
+// Uso: ./server [--hilos N] [--afinidad] [--espera S]
+//   --hilos N    hilos del pool que atiende conexiones (por defecto uno por CPU)
+//   --afinidad   fija cada hilo del pool a una CPU
+//   --espera S   segundos que se esperan los datos de un cliente (por defecto 5)
 int main(int argc, char** argv)
 {
+    int numHilos = 0;
+    bool afinidad = false;
+    for(int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if(arg == "--hilos" && i + 1 < argc)
+            numHilos = atoi(argv[++i]);
+        else if(arg == "--afinidad")
+            afinidad = true;
+        else if(arg == "--espera" && i + 1 < argc)
+        {
+            segundosEspera = atoi(argv[++i]);
+            if(segundosEspera <= 0)
+                segundosEspera = 5;
+        }
+    }
+
+    // Los clientes se atienden como tareas del pool, sin crear un hilo por conexión
+    Ejecutor ejecutor(numHilos, afinidad);
+    cout << "Pool de " << ejecutor.numHilos() << " hilos" << (afinidad ? " con afinidad" : "") << endl;
+
     cout << "Iniciando servidor en puerto 3000..." << endl;
     auto conn = initServer(3000);
     cout << "Servidor listo y esperando conexiones..." << endl;
@@ -61,12 +95,10 @@ int main(int argc, char** argv)
 
     while(1)
     {
-        while(!checkClient()) usleep(100);
-
-        int clientId = getLastClientID();
+        // Espera bloqueante: el hilo de accept avisa con cada conexión nueva
+        int clientId = waitForClient();
 
-        thread* th = new thread(atiendeConexion, clientId);
-        th->detach();
+        ejecutor.enviar([clientId]() { atiendeConexion(clientId); });
     }
 
     close(conn);
@@ -0,0 +1,51 @@
+#include "tablaHash.h"
+
+#include <functional>
+
+TablaHash::TablaHash(size_t capacidadInicial) : numElementos(0) {
+    size_t capacidad = 8;
+    while (capacidad < capacidadInicial) {
+        capacidad <<= 1;
+    }
+    entradas.resize(capacidad, Entrada{0, -1, std::string()});
+}
+
+size_t TablaHash::posicion(std::string_view clave, size_t hash) const {
+    size_t mascara = entradas.size() - 1;
+    size_t i = hash & mascara;
+    while (entradas[i].valor >= 0 &&
+           (entradas[i].hash != hash || entradas[i].clave != clave)) {
+        i = (i + 1) & mascara;
+    }
+    return i;
+}
+
+int TablaHash::buscar(std::string_view clave) const {
+    size_t hash = std::hash<std::string_view>()(clave);
+    return entradas[posicion(clave, hash)].valor;
+}
+
+void TablaHash::insertar(std::string_view clave, int valor) {
+    // Ocupación máxima 1/2 para que los sondeos sigan siendo cortos
+    if ((numElementos + 1) * 2 > entradas.size()) {
+        crecer();
+    }
+    size_t hash = std::hash<std::string_view>()(clave);
+    Entrada& entrada = entradas[posicion(clave, hash)];
+    if (entrada.valor < 0) {
+        entrada.hash = hash;
+        entrada.clave = clave;
+        ++numElementos;
+    }
+    entrada.valor = valor;
+}
+
+void TablaHash::crecer() {
+    std::vector<Entrada> anteriores(entradas.size() * 2, Entrada{0, -1, std::string()});
+    anteriores.swap(entradas);
+    for (Entrada& entrada : anteriores) {
+        if (entrada.valor >= 0) {
+            entradas[posicion(entrada.clave, entrada.hash)] = std::move(entrada);
+        }
+    }
+}
@@ -0,0 +1,50 @@
+/*
+ * tablaHash.h - Tabla hash plana de cadenas a enteros
+ *
+ * Direccionamiento abierto con sondeo lineal sobre un único vector de
+ * entradas: una búsqueda recorre posiciones contiguas en vez de saltar por
+ * nodos como std::map o std::unordered_map. Cada entrada guarda el hash
+ * completo, así que solo se comparan cadenas cuando el hash coincide.
+ *
+ * Pensada para internar nombres: no hay borrado, y los valores negativos
+ * están reservados (buscar devuelve -1 si la clave no existe).
+ */
+
+#ifndef _TABLA_HASH_H_
+#define _TABLA_HASH_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class TablaHash {
+
+public:
+    TablaHash() : TablaHash(64) {}
+    explicit TablaHash(size_t capacidadInicial);
+
+    // Valor asociado a clave o -1 si no está
+    int buscar(std::string_view clave) const;
+
+    // Asocia valor (>= 0) a clave, sustituyendo el anterior si ya estaba
+    void insertar(std::string_view clave, int valor);
+
+    size_t size() const { return numElementos; }
+
+private:
+    struct Entrada {
+        size_t hash;
+        int valor;          // -1: posición libre
+        std::string clave;
+    };
+
+    // Posición de clave o de la libre donde iría
+    size_t posicion(std::string_view clave, size_t hash) const;
+    void crecer();
+
+    std::vector<Entrada> entradas;      // Tamaño potencia de 2
+    size_t numElementos;
+};
+
+#endif
@@ -1,15 +1,310 @@
 #include "utils.h"
+#include "pool.h"
+#include "compresion.h"
 #include <map>
 #include <thread>
 #include <mutex>
-
-std::map<unsigned int,connection_t> clientList;
-unsigned int contador=0;
+#include <atomic>
+#include <condition_variable>
+#include <cerrno>
+#include <climits>
+#include <poll.h>
+
+//cabeceras y datos de los mensajes de recvMSGAsync. Se define antes que
+//clientList para destruirse después: al destruir clientList, las bandejas
+//que queden devuelven sus mensajes al pool
+PoolBloques poolMensajes;
+Registro<connection_t> clientList(MAX_CONNECTIONS);
 bool salir=false;
 std::thread* waitForConnectionsThread;
 int lastClientSize=0;
+//conexiones aceptadas pendientes de atender: el hilo de accept las deja aquí
+//y avisa por waitingCond a quien espere en waitForClient
 std::list<unsigned int> waitingClients;
-std::mutex contador_mutex;
+std::mutex waitingMutex;
+std::condition_variable waitingCond;
+//generación de cada slot: cambia cada vez que se publica en él una conexión
+static std::atomic<unsigned int> slotGenerations[MAX_CONNECTIONS];
+
+unsigned int newConnectionID(int slot)
+{
+    //15 bits de generación para que el ID siga siendo un int positivo
+    unsigned int generation=(slotGenerations[slot].fetch_add(1)+1)&0x7fff;
+    return generation<<CONNECTION_SLOT_BITS | slot;
+}
+
+connection_t getConnection(int clientID)
+{
+    connection_t connection;
+    if(clientID<0 || !clientList.obtener(connectionSlot(clientID),connection) ||
+       connection.serverId!=(unsigned int)clientID)
+    {
+        connection.id=clientID;
+        connection.socket=-1;
+        connection.socketOwner=nullptr;
+        connection.buffer=nullptr;
+        connection.reader=nullptr;
+        connection.alive=false;
+    }
+    return connection;
+}
+
+bool sendAll(int socket, struct iovec* iov, int iovcnt, bool more)
+{
+    while(iovcnt>0)
+    {
+        //sendmsg admite como mucho IOV_MAX bloques: si quedan más, MSG_MORE
+        int chunk=iovcnt<IOV_MAX ? iovcnt : IOV_MAX;
+        struct msghdr msg;
+        memset(&msg,0,sizeof(msg));
+        msg.msg_iov=iov;
+        msg.msg_iovlen=chunk;
+        int flags=MSG_NOSIGNAL;
+        if(more || chunk<iovcnt)
+            flags|=MSG_MORE;
+
+        ssize_t sent=sendmsg(socket,&msg,flags);
+        if(sent<0)
+        {
+            if(errno==EINTR)
+                continue;
+            if(errno==EAGAIN || errno==EWOULDBLOCK)
+            {
+                struct pollfd pfd={socket,POLLOUT,0};
+                poll(&pfd,1,-1);
+                continue;
+            }
+            printf("ERROR: sendAll -- line : %d %s\n", __LINE__, strerror(errno));
+            return false;
+        }
+
+        //saltar los bloques enviados enteros y recortar el parcial
+        while(iovcnt>0 && (size_t)sent>=iov->iov_len)
+        {
+            sent-=iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if(iovcnt>0)
+        {
+            iov->iov_base=(char*)iov->iov_base+sent;
+            iov->iov_len-=sent;
+        }
+    }
+    return true;
+}
+
+bool sendAll(const connection_t &connection, struct iovec* iov, int iovcnt, bool more)
+{
+    std::lock_guard<std::mutex> lock(connection.socketOwner->sendMutex);
+    return sendAll(connection.socket,iov,iovcnt,more);
+}
+
+int FrameReader::parseHeader(size_t &headerSize, size_t &frameSize, unsigned char &frameFlags) const
+{
+    size_t available=end-start;
+    const unsigned char* header=buffer.data()+start;
+    if(version==PROTOCOL_V1)
+    {
+        if(available<sizeof(int))
+            return 0;
+        int size;
+        memcpy(&size,header,sizeof(int));
+        if(size<0 || size>MAX_FRAME)
+            return -1;
+        headerSize=sizeof(int);
+        frameSize=size;
+        frameFlags=0;
+        return 1;
+    }
+
+    if(available<1)
+        return 0;
+    if((header[0]>>4)!=version)
+        return -1;
+    uint64_t size=0;
+    for(size_t i=1;i<=MAX_VARINT_BYTES;i++)
+    {
+        if(i>=available)
+            return 0;
+        size|=(uint64_t)(header[i]&0x7f)<<(7*(i-1));
+        if(!(header[i]&0x80))
+        {
+            if(size>MAX_FRAME)
+                return -1;
+            headerSize=i+1;
+            frameSize=size;
+            frameFlags=header[0]&0x0f;
+            return 1;
+        }
+    }
+    return -1;
+}
+
+bool FrameReader::nextFrame(int socket, const unsigned char* &data, size_t &size)
+{
+    //la trama anterior ya no se usa: con todo entregado se vuelve al tamaño
+    //inicial en vez de mantener la memoria de la trama más grande recibida
+    if(start==end && buffer.size()>initialCapacity)
+    {
+        std::vector<unsigned char>(initialCapacity).swap(buffer);
+        start=end=0;
+    }
+    if(unpacked.capacity()>initialCapacity)
+        std::vector<unsigned char>().swap(unpacked);
+
+    while(true)
+    {
+        size_t available=end-start;
+        size_t headerSize,frameSize;
+        unsigned char frameFlags;
+        int header=parseHeader(headerSize,frameSize,frameFlags);
+        if(header<0)
+        {
+            printf("ERROR: nextFrame -- line : %d invalid frame header\n", __LINE__);
+            return false;
+        }
+        //sin cabecera completa basta con leer algo más
+        size_t needed=available+1;
+        if(header>0)
+        {
+            needed=headerSize+frameSize;
+            if(available>=needed)
+            {
+                data=buffer.data()+start+headerSize;
+                size=frameSize;
+                flags=frameFlags;
+                start+=needed;
+                if(flags&FRAME_LZ)
+                {
+                    if(!descomprimirLZ(data,size,unpacked,MAX_FRAME))
+                    {
+                        printf("ERROR: nextFrame -- line : %d invalid compressed frame\n", __LINE__);
+                        return false;
+                    }
+                    data=unpacked.data();
+                    size=unpacked.size();
+                }
+                return true;
+            }
+        }
+
+        //trama incompleta: mover lo pendiente al principio y hacer sitio
+        if(start>0)
+        {
+            memmove(buffer.data(),buffer.data()+start,available);
+            start=0;
+            end=available;
+        }
+        if(needed>buffer.size())
+            buffer.resize(needed);
+
+        ssize_t readData=read(socket,buffer.data()+end,buffer.size()-end);
+        if(readData==0)
+            return false;
+        if(readData<0)
+        {
+            if(errno==EINTR)
+                continue;
+            printf("ERROR: nextFrame -- line : %d %s\n", __LINE__, strerror(errno));
+            return false;
+        }
+        end+=readData;
+    }
+}
+
+bool FrameReader::pending() const
+{
+    size_t headerSize,frameSize;
+    unsigned char frameFlags;
+    return parseHeader(headerSize,frameSize,frameFlags)>0 &&
+           end-start>=headerSize+frameSize;
+}
+
+bool pendingFrame(int clientID)
+{
+    connection_t connection=getConnection(clientID);
+    return connection.reader!=nullptr && connection.reader->pending();
+}
+
+void setProtocolVersion(int clientID, int version)
+{
+    connection_t connection=getConnection(clientID);
+    if(connection.reader!=nullptr)
+        connection.reader->setVersion(version);
+}
+
+bool sendFrame(int clientID, std::vector<unsigned char> &payload, int version,
+               unsigned char flags, bool more)
+{
+    if(version==PROTOCOL_V1)
+        return sendMSG(clientID,payload,more);
+
+    connection_t connection=getConnection(clientID);
+    if(connection.socket<0)
+        return false;
+
+    unsigned char header[MAX_FRAME_HEADER];
+    size_t headerSize=encodeFrameHeader(payload.size(),version,flags,header);
+
+    struct iovec iov[2];
+    iov[0].iov_base=header;
+    iov[0].iov_len=headerSize;
+    iov[1].iov_base=payload.data();
+    iov[1].iov_len=payload.size();
+    return sendAll(connection,iov,2,more);
+}
+
+bool compressFrame(const std::vector<unsigned char> &payload, std::vector<unsigned char> &compressed)
+{
+    compressed.clear();
+    return payload.size()>=UMBRAL_COMPRESION &&
+           comprimirLZ(payload.data(),payload.size(),compressed);
+}
+
+bool recvFrame(int clientID, PacketReader &frame)
+{
+    connection_t connection=getConnection(clientID);
+    const unsigned char* data;
+    size_t size;
+    if(connection.reader==nullptr || !connection.reader->nextFrame(connection.socket,data,size))
+        return false;
+    frame=PacketReader(data,size);
+    return true;
+}
+
+void FrameBatch::addFrame(const void* data, size_t size, int version, unsigned char flags)
+{
+    unsigned char header[MAX_FRAME_HEADER];
+    size_t headerSize=encodeFrameHeader(size,version,flags,header);
+    headerBytes.insert(headerBytes.end(),header,header+headerSize);
+    headerSizes.push_back(headerSize);
+    bodies.push_back({(void*)data,size});
+}
+
+bool FrameBatch::flush(int clientID, bool more)
+{
+    connection_t connection=getConnection(clientID);
+    bool ok=connection.socket>=0;
+    if(ok && !bodies.empty())
+    {
+        //cabecera y cuerpo de cada trama, en orden
+        std::vector<struct iovec> iov(2*bodies.size());
+        size_t offset=0;
+        for(size_t i=0;i<bodies.size();i++)
+        {
+            iov[2*i].iov_base=headerBytes.data()+offset;
+            iov[2*i].iov_len=headerSizes[i];
+            iov[2*i+1]=bodies[i];
+            offset+=headerSizes[i];
+        }
+        ok=sendAll(connection,iov.data(),iov.size(),more);
+    }
+    headerBytes.clear();
+    headerSizes.clear();
+    bodies.clear();
+    return ok;
+}
 
 int initServer(int port)
 {
@@ -25,9 +320,8 @@ int initServer(int port)
     serv_addr.sin_port = htons(port);
 
     int option = 1;
-    setsockopt(sock_fd,SOL_SOCKET,
-               (SO_REUSEPORT | SO_REUSEADDR),
-               &option,sizeof(option));
+    setsockopt(sock_fd,SOL_SOCKET,SO_REUSEADDR,&option,sizeof(option));
+    setsockopt(sock_fd,SOL_SOCKET,SO_REUSEPORT,&option,sizeof(option));
 
     if (bind(sock_fd,(struct sockaddr * ) &serv_addr,
              sizeof(serv_addr)) < 0)
@@ -84,15 +378,25 @@ connection_t initClient(std::string host, int port)
 
     connection.id=localID;
     connection.socket=sock_out;
-    connection.buffer=new std::list<msg_t*>();
+    connection.socketOwner=std::make_shared<SharedSocket>(sock_out);
+    connection.buffer=newInbox();
+    connection.reader=std::make_shared<FrameReader>();
     connection.alive=true;
 
-    contador_mutex.lock();
-      connection.serverId=contador;
-      clientList[contador]=connection;
-      printf("Cliente registrado con ID: %d\n", contador);
-      contador++;
-    contador_mutex.unlock();
+    int slot=clientList.reservar();
+    if(slot<0)
+    {
+        printf("Demasiadas conexiones abiertas\n");
+        connection.socketOwner=nullptr;
+        connection.buffer=nullptr;
+        connection.reader=nullptr;
+        connection.socket=-1;
+        connection.alive=false;
+        return connection;
+    }
+    connection.serverId=newConnectionID(slot);
+    clientList.publicar(slot,connection);
+    printf("Cliente registrado con ID: %d\n", connection.serverId);
     return connection;
 }
 
@@ -111,41 +415,69 @@ int waitForConnections(int sock_fd){
     int newsock_fd = accept(sock_fd,
                             (struct sockaddr * ) &cli_addr,
                             &clilen);
+    if(newsock_fd<0)
+    {
+        printf("ERROR: accept -- line : %d %s\n", __LINE__, strerror(errno));
+        return -1;
+    }
     connection_t client;
-    contador_mutex.lock();
-     client.id=contador;
-     contador++;
-    contador_mutex.unlock();
-
+    int slot=clientList.reservar();
+    if(slot<0)
+    {
+        printf("ERROR: demasiadas conexiones, se rechaza el cliente\n");
+        close(newsock_fd);
+        return -1;
+    }
+    client.id=newConnectionID(slot);
+    client.serverId=client.id;
     client.alive=true;
     client.socket=newsock_fd;
-    client.buffer=new std::list<msg_t*>();
-    clientList[client.id]=client;
+    client.socketOwner=std::make_shared<SharedSocket>(newsock_fd);
+    client.buffer=newInbox();
+    client.reader=std::make_shared<FrameReader>();
+    clientList.publicar(slot,client);
 
-    waitingClients.push_back(client.id);
+    {
+        std::lock_guard<std::mutex> lock(waitingMutex);
+        waitingClients.push_back(client.id);
+    }
+    waitingCond.notify_one();
 
     return newsock_fd;
 }
 
-void closeConnection(int clientID){
-    connection_t connection=clientList[clientID];
-    close(connection.socket);
-    connection.alive=false;
+std::shared_ptr<AnilloSPSC<msg_t*>> newInbox()
+{
+    return std::shared_ptr<AnilloSPSC<msg_t*>>(new AnilloSPSC<msg_t*>(INBOX_CAPACITY),
+        [](AnilloSPSC<msg_t*>* buffer){
+            //ya no queda productor ni consumidor
+            msg_t* msg;
+            while(buffer->sacar(msg))
+                freeMSG(msg);
+            delete buffer;
+        });
+}
 
-    if(checkPendingMessages(clientID))
+void closeConnection(int clientID){
+    connection_t connection=getConnection(clientID);
+    if(connection.socket<0)
+        return;
+    //despierta a recvMSGAsync si está en recv; después recv devuelve 0.
+    //El descriptor lo cierra la última copia de la conexión (SharedSocket)
+    shutdown(connection.socket,SHUT_RDWR);
+
+    if(connection.buffer!=nullptr)
     {
-      printf("ERROR: unread messages from %d\n",connection.id );
-      for(std::list<msg_t*>::iterator t=connection.buffer->begin();
-          t!=connection.buffer->end();t++)
-      {
-          msg_t* msg=*t;
-          delete[] msg->data;
-          delete[] msg;
-      }
-      delete connection.buffer;
-
+      //despierta a recvMSGAsync si espera sitio y a quien espere en waitMSG.
+      //Lo que quede en la bandeja se libera con su última copia
+      connection.buffer->cerrar();
+      if(checkPendingMessages(clientID))
+        printf("ERROR: unread messages from %d\n",connection.id );
     }
-        clientList.erase(clientID);
+    //solo si el slot sigue siendo de esta conexión
+    clientList.eliminarSi(connectionSlot(clientID),[clientID](const connection_t &c){
+        return c.serverId==(unsigned int)clientID;
+    });
 }
 
 
@@ -153,20 +485,61 @@ void closeConnection(int clientID){
 
 void recvMSGAsync(connection_t connection){
 
-    while(connection.alive){
-        msg_t* msg=new msg_t[1];
-        std::vector<unsigned char> data;
-        recvMSG<unsigned char>(connection.socket, data);
-        msg->data=new unsigned char[data.size()];
-        memcpy(msg->data,data.data(),data.size());
-        msg->size=data.size();
-        connection.buffer->push_back(msg);
+    //cada trama se copia del buffer de lectura a un bloque del pool, que
+    //pasa tal cual a la bandeja (takeMSG lo entrega sin otra copia)
+    //si la bandeja está llena se deja de leer del socket hasta que haya sitio
+    const unsigned char* frame;
+    size_t frameSize;
+    //la copia de la conexión mantiene vivos la bandeja y el lector aunque
+    //otro hilo la cierre; tras cerrar ya no se vuelve a leer del socket
+    while(connection.alive && !connection.buffer->estaCerrado() &&
+          connection.reader->nextFrame(connection.socket,frame,frameSize)){
+        msg_t* msg=allocMSG(frameSize);
+        memcpy(msg->data,frame,frameSize);
+        if(!connection.buffer->meterEsperando(msg)){
+            freeMSG(msg);
+            return;
+        }
     }
+    //conexión cerrada: waitMSG devuelve lo que quede y luego nullptr
+    connection.buffer->cerrar();
+}
+
+msg_t* allocMSG(int size)
+{
+    msg_t* msg=(msg_t*)poolMensajes.reservar(sizeof(msg_t)+size);
+    msg->size=size;
+    msg->data=(unsigned char*)(msg+1);
+    return msg;
+}
+
+void freeMSG(msg_t* msg)
+{
+    poolMensajes.liberar(msg,sizeof(msg_t)+msg->size);
+}
+
+msg_t* takeMSG(int clientID)
+{
+    connection_t connection=getConnection(clientID);
+    msg_t* msg;
+    if(connection.buffer==nullptr || !connection.buffer->sacar(msg))
+        return nullptr;
+    return msg;
+}
+
+msg_t* waitMSG(int clientID)
+{
+    connection_t connection=getConnection(clientID);
+    msg_t* msg;
+    if(connection.buffer==nullptr || !connection.buffer->sacarEsperando(msg))
+        return nullptr;
+    return msg;
 }
 
 bool checkPendingMessages(int clientID)
 {
-    return clientList[clientID].buffer->size()>0 ;
+    connection_t connection=getConnection(clientID);
+    return connection.buffer!=nullptr && !connection.buffer->vacio();
 }
 
 
@@ -174,10 +547,20 @@ bool checkPendingMessages(int clientID)
 
 bool checkClient()
 {
+    std::lock_guard<std::mutex> lock(waitingMutex);
     return waitingClients.size()>0;
 
 }
 
+int waitForClient()
+{
+    std::unique_lock<std::mutex> lock(waitingMutex);
+    waitingCond.wait(lock,[](){ return !waitingClients.empty(); });
+    int id=waitingClients.front();
+    waitingClients.pop_front();
+    return id;
+}
+
 int getNumClients()
 {
     return clientList.size();
@@ -185,12 +568,15 @@ int getNumClients()
 
 int getClientID(int numClient)
 {
-    return clientList[numClient].id;
+    return getConnection(numClient).id;
 
 }
 
 int getLastClientID()
 {
+    std::lock_guard<std::mutex> lock(waitingMutex);
+    if(waitingClients.empty())
+        return -1;
     int id=waitingClients.back();
     waitingClients.pop_back();
     return id;
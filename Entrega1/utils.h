@@ -4,6 +4,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 
 #include <netinet/in.h>
@@ -15,6 +16,15 @@
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <memory>
+#include <string_view>
+#include <stdexcept>
+#include <type_traits>
+#include <iterator>
+#include <cstdint>
+
+#include "registro.h"
+#include "anillo.h"
 
 
 
@@ -33,23 +43,152 @@ typedef struct msg_t
     unsigned char* data;
 }msg_t;
 
+//mensaje recibido: cabecera y datos en un mismo bloque del pool de mensajes
+msg_t* allocMSG(int size);
+void freeMSG(msg_t* msg);
+
+//mensajes que caben en la bandeja de entrada de una conexión
+#define INBOX_CAPACITY 1024
+
+//tamaño máximo de trama aceptado: una cabecera mayor se trata como error
+#define MAX_FRAME (64*1024*1024)
+
+//versiones del formato de trama, se negocian en el login (clientManager):
+//  v1  [int tamaño][datos], orden de bytes de la máquina
+//  v2  [versión<<4 | flags][tamaño varint][datos]: un byte fijo más el
+//      tamaño en base 128 (7 bits por byte, el bit alto indica que sigue)
+#define PROTOCOL_V1 1
+#define PROTOCOL_V2 2
+#define MAX_VARINT_BYTES 10
+
+//escribe v en base 128 (menos significativo primero), devuelve los bytes usados
+inline size_t encodeVarint(uint64_t v, unsigned char* out)
+{
+    size_t n=0;
+    while(v>=0x80)
+    {
+        out[n++]=(unsigned char)(v|0x80);
+        v>>=7;
+    }
+    out[n++]=(unsigned char)v;
+    return n;
+}
+
+//cabecera de una trama de size bytes; out debe tener MAX_FRAME_HEADER bytes.
+//Devuelve los bytes usados
+#define MAX_FRAME_HEADER (1+MAX_VARINT_BYTES)
+//flag v2: datos comprimidos con comprimirLZ (compresion.h). Solo se usa si
+//la conexión lo acordó y la carga llega al umbral; por debajo no compensa
+#define FRAME_LZ 0x1
+#define UMBRAL_COMPRESION 512
+inline size_t encodeFrameHeader(size_t size, int version, unsigned char flags, unsigned char* out)
+{
+    if(version==PROTOCOL_V1)
+    {
+        int size32=size;
+        memcpy(out,&size32,sizeof(int));
+        return sizeof(int);
+    }
+    out[0]=(unsigned char)(version<<4 | (flags&0x0f));
+    return 1+encodeVarint(size,out+1);
+}
+
+//lector de tramas de una conexión (v1 al empezar). Cada read trae todo lo
+//que haya en el socket y las tramas completas se entregan desde el buffer sin
+//copiarlas ni volver a leer del socket
+class FrameReader{
+public:
+    FrameReader(size_t capacity=64*1024):
+        buffer(capacity),initialCapacity(capacity),start(0),end(0),version(PROTOCOL_V1),flags(0){}
+
+    //siguiente trama completa; data apunta al buffer (o a la copia
+    //descomprimida si llegó con FRAME_LZ) y vale hasta la próxima llamada.
+    //Devuelve false si la conexión se cerró, hubo error o la trama no es válida.
+    //Los buffers que haya hecho crecer una trama grande se sueltan en la
+    //siguiente llamada si ya está todo entregado
+    bool nextFrame(int socket, const unsigned char* &data, size_t &size);
+
+    //hay una trama completa en el buffer (nextFrame no leerá del socket)
+    bool pending() const;
+
+    //formato de las tramas siguientes (solo desde el hilo que lee)
+    void setVersion(int v) { version=v; }
+    int getVersion() const { return version; }
+    //flags de la cabecera v2 de la última trama entregada
+    unsigned char lastFlags() const { return flags; }
+
+private:
+    //cabecera en start: 1 completa, 0 faltan bytes, -1 no válida
+    int parseHeader(size_t &headerSize, size_t &frameSize, unsigned char &frameFlags) const;
+
+    std::vector<unsigned char> buffer;
+    size_t initialCapacity;
+    size_t start;   //primer byte sin entregar
+    size_t end;     //fin de los datos leídos
+    int version;
+    unsigned char flags;
+    std::vector<unsigned char> unpacked;    //última trama descomprimida
+};
+
+//descriptor de una conexión: se cierra al destruirse, con la última copia de
+//la conexión. closeConnection solo hace shutdown; si cerrase el descriptor,
+//un hilo que aún estuviese en read o send sobre él podría acabar usando el
+//mismo número reasignado por el siguiente accept
+class SharedSocket{
+public:
+    explicit SharedSocket(int fd):fd(fd){}
+    ~SharedSocket() { close(fd); }
+    SharedSocket(const SharedSocket&)=delete;
+    SharedSocket& operator=(const SharedSocket&)=delete;
+
+    //se toma durante el envío completo de una o varias tramas: varios hilos
+    //escriben en el mismo socket (respuestas propias y reenvíos de otros
+    //clientes) y sendAll puede partir una trama en varios sendmsg
+    std::mutex sendMutex;
+
+private:
+    int fd;
+};
+
 typedef struct connection_t{
     unsigned int id;
     unsigned int serverId;
     int socket;
-    std::list<msg_t*>* buffer;
+    //compartidos con las copias de la conexión (recvMSGAsync, recvFrame...):
+    //se liberan con la última, no al cerrarla, así un hilo que aún los use
+    //no toca memoria liberada ni un descriptor ya cerrado
+    std::shared_ptr<SharedSocket> socketOwner;    //cierra socket
+    std::shared_ptr<AnilloSPSC<msg_t*>> buffer;   //bandeja de recvMSGAsync
+    std::shared_ptr<FrameReader> reader;
     bool alive;
 }connection_t;
 
 int initServer(int port);
 bool checkClient();
 connection_t initClient(std::string host, int port);
+//bandeja nueva; al destruirla devuelve al pool los mensajes que queden
+std::shared_ptr<AnilloSPSC<msg_t*>> newInbox();
 
 
 template<typename t>
-void sendMSG(int clientID, std::vector<t> &data);
+bool sendMSG(int clientID, std::vector<t> &data, bool more=false);
 template<typename t>
-void recvMSG(int clientID, std::vector<t> &data);
+bool recvMSG(int clientID, std::vector<t> &data);
+
+class PacketReader;
+//siguiente trama de la conexión como PacketReader sobre su buffer de lectura
+//(sin copia, vale hasta la próxima lectura). false si se desconectó
+bool recvFrame(int clientID, PacketReader &frame);
+//la conexión tiene ya recibida otra trama completa
+bool pendingFrame(int clientID);
+//cambia el formato con el que se leen las tramas de la conexión
+void setProtocolVersion(int clientID, int version);
+//envía payload como una trama del formato indicado (flags solo en v2)
+bool sendFrame(int clientID, std::vector<unsigned char> &payload, int version,
+               unsigned char flags=0, bool more=false);
+//payload comprimido en compressed si llega a UMBRAL_COMPRESION y ocupa menos;
+//se envía con sendFrame(..., PROTOCOL_V2, FRAME_LZ)
+bool compressFrame(const std::vector<unsigned char> &payload, std::vector<unsigned char> &compressed);
 
 int waitForConnections(int sock_fd);
 void closeConnection(int clientID);
@@ -57,88 +196,142 @@ template<typename t>
 void getMSG(int clientID, std::vector<t> &data);
 
 bool checkPendingMessages(int clientID);
+//saca el siguiente mensaje de la bandeja sin copiarlo (nullptr si no hay);
+//el llamante lo devuelve al pool con freeMSG
+msg_t* takeMSG(int clientID);
+//como takeMSG pero espera a que llegue uno; nullptr si se cerró la conexión
+msg_t* waitMSG(int clientID);
 void recvMSGAsync(connection_t connection);
 void waitForConnectionsAsync(int server_fd);
 
 int getNumClients();
 int getClientID(int numClient);
 int getLastClientID();
+//bloquea sin consumir CPU hasta que el hilo de accept entrega una conexión
+int waitForClient();
+
+
+
+//conexiones activas. El ID de una conexión es su slot en el registro con la
+//generación del slot en los bits altos: un ID antiguo no encuentra la
+//conexión que ocupe después el mismo slot
+#define MAX_CONNECTIONS 65536
+#define CONNECTION_SLOT_BITS 16
+extern Registro<connection_t> clientList;
+
+inline int connectionSlot(int clientID) { return clientID & (MAX_CONNECTIONS-1); }
+//ID para la conexión que se va a publicar en slot (avanza su generación)
+unsigned int newConnectionID(int slot);
+
+//copia de la conexión con ese ID (socket -1 y buffer nulo si no existe o si
+//su slot ya es de otra conexión)
+connection_t getConnection(int clientID);
+
+//envía todos los bytes de iov (modifica iov) reanudando escrituras parciales.
+//more: vienen más tramas detrás y el kernel puede juntarlas (MSG_MORE)
+bool sendAll(int socket, struct iovec* iov, int iovcnt, bool more=false);
+//igual, con el cerrojo de envío de la conexión tomado todo el tiempo para
+//que las tramas de otros hilos no se intercalen con estas
+bool sendAll(const connection_t &connection, struct iovec* iov, int iovcnt, bool more=false);
+
+//lote de tramas para una conexión: add guarda la cabecera y apunta al cuerpo
+//(que debe seguir vivo hasta flush); flush las envía juntas con sendmsg
+class FrameBatch{
+public:
+    template<typename t>
+    void add(const std::vector<t> &data)
+    {
+        addFrame(data.data(),data.size()*sizeof(t),PROTOCOL_V1);
+    }
 
+    //trama en el formato indicado (flags solo en v2)
+    void addFrame(const void* data, size_t size, int version, unsigned char flags=0);
 
+    bool flush(int clientID, bool more=false);
+    size_t size() const { return bodies.size(); }
 
-extern std::map<unsigned int,connection_t> clientList;
+private:
+    std::vector<unsigned char> headerBytes;   //cabeceras, una tras otra
+    std::vector<size_t> headerSizes;
+    std::vector<struct iovec> bodies;
+};
 
 
 template<typename t>
-void recvMSG(int clientID, std::vector<t> &data){
+bool recvMSG(int clientID, std::vector<t> &data){
 
+    connection_t connection=getConnection(clientID);
 
-    connection_t connection=clientList[clientID];
-
-    int socket= connection.socket;
-
-    int bufferSize=0;
-    int readData=read(socket, &bufferSize, sizeof(int));
-    DEBUG_MSG("DatosLeidos : %d\n",bufferSize);
-	if(readData==0)
-    {
-       printf("ERROR: recvMSG -- line : %d lost connection\n", __LINE__);
-    }
-	
-    int numElements=bufferSize/sizeof(t);
-    data.resize(numElements);
-    int remaining=bufferSize;
-    int idxIn=0;
-    while(remaining>0)
-    {
-        int bufferSizeBlock=read(socket, &(data.data()[bufferSize-remaining]),remaining);
-        remaining-=bufferSizeBlock;        
-    }
-    
-    if(remaining!=0)
+    const unsigned char* frame;
+    size_t frameSize;
+    if(connection.reader==nullptr ||
+       !connection.reader->nextFrame(connection.socket,frame,frameSize))
     {
-       printf("ERROR: recvMSG -- line : %d error data not matching: %d read, %d espected\n", __LINE__,remaining,bufferSize);
+        data.resize(0);
+        return false;
     }
+
+    data.resize(frameSize/sizeof(t));
+    memcpy(data.data(),frame,data.size()*sizeof(t));
+    return true;
 }
 
 
 template<typename t>
-void sendMSG(int clientID, std::vector<t> &data){
+bool sendMSG(int clientID, std::vector<t> &data, bool more){
 
     int dataLen=data.size()*sizeof(t);
-    connection_t connection=clientList[clientID];
-
-    int socket= connection.socket;
-
-    //enviar tamaño buffer
-    write(socket,&dataLen,sizeof(int));
-    //enviar buffer
-    write(socket,data.data(),dataLen);
+    connection_t connection=getConnection(clientID);
+
+    if(connection.socket<0)
+        return false;
+
+    //enviar tamaño buffer (cabecera) y buffer en una sola llamada
+    struct iovec iov[2];
+    iov[0].iov_base=&dataLen;
+    iov[0].iov_len=sizeof(int);
+    iov[1].iov_base=data.data();
+    iov[1].iov_len=dataLen;
+    return sendAll(connection,iov,2,more);
 }
 
 template<typename t>
 void getMSG(int clientID,std::vector<t> &data)
 {
-    if(!checkPendingMessages(clientID))
+    msg_t* msg=takeMSG(clientID);
+    if(msg==nullptr)
     {
 	data.resize(0);
     }
     else
-    {   msg_t* msg=clientList[clientID].buffer->front();
-        clientList[clientID].buffer->pop_front();
+    {
         int numElem=msg->size/sizeof(t);
         data.resize(numElem);
-        memcpy(data.data(),msg->data,msg->size);
-	delete[] msg->data;
-        delete[] msg;
+        memcpy(data.data(),msg->data,numElem*sizeof(t));
+        freeMSG(msg);
     }
 }
 
 
 
+//solo se empaquetan tipos que se pueden copiar byte a byte; cualquier otro
+//(std::string, punteros a datos propios...) es un error de compilación
+template<typename T>
+constexpr bool isPackable=std::is_trivially_copyable_v<T>;
+
+//rango contiguo (vector, string, string_view, array...): std::data y std::size
+template<typename R,typename=void>
+struct contiguousRange : std::false_type{};
+template<typename R>
+struct contiguousRange<R,std::void_t<decltype(std::data(std::declval<R&>())),
+                                    decltype(std::size(std::declval<R&>()))>> : std::true_type{};
+
+
+
 template<typename T>
 inline void pack(std::vector<unsigned char> &packet,T data){
-	
+	static_assert(isPackable<T>,"pack: el tipo debe ser trivialmente copiable");
+
 	int size=packet.size();
 	unsigned char *ptr=(unsigned char*)&data;
 	packet.resize(size+sizeof(T));
@@ -147,36 +340,202 @@ inline void pack(std::vector<unsigned char> &packet,T data){
 }
 
 
+//todos los elementos en una sola copia
 template<typename T>
-inline void packv(std::vector<unsigned char> &packet,T* data,int dataSize)
+inline void packv(std::vector<unsigned char> &packet,const T* data,size_t dataSize)
 {
-	for(int i=0;i<dataSize;i++)
-			 	pack(packet,data[i]);
+	static_assert(isPackable<T>,"packv: el tipo debe ser trivialmente copiable");
+	const unsigned char *ptr=(const unsigned char*)data;
+	packet.insert(packet.end(),ptr,ptr+dataSize*sizeof(T));
+}
+
+template<typename R,typename=std::enable_if_t<contiguousRange<const R>::value>>
+inline void packv(std::vector<unsigned char> &packet,const R &range)
+{
+	packv(packet,std::data(range),std::size(range));
 }
 
 
 
+//lectura desde offset, que avanza lo leído: el paquete no se modifica, así
+//que desempaquetar n campos es O(n) y no mueve el resto en cada llamada
+inline void checkUnpack(const std::vector<unsigned char> &packet,size_t offset,size_t bytes)
+{
+	if(offset>packet.size() || bytes>packet.size()-offset)
+		throw std::out_of_range("unpack: paquete truncado");
+}
+
 template<typename T>
-inline T unpack(std::vector<unsigned char> &packet){	
+inline T unpack(const std::vector<unsigned char> &packet,size_t &offset){
+	static_assert(isPackable<T>,"unpack: el tipo debe ser trivialmente copiable");
+	checkUnpack(packet,offset,sizeof(T));
 	T data;
-	long int dataSize=sizeof(T);
-	int packetSize=packet.size();
-	memcpy(&data,packet.data(),dataSize);
-	memcpy(packet.data(),packet.data()+dataSize,packetSize-dataSize);
-	packet.resize(packetSize-dataSize);
+	memcpy(&data,packet.data()+offset,sizeof(T));
+	offset+=sizeof(T);
 	return data;
 }
 
 
 
 template<typename T>
-inline void unpackv(std::vector<unsigned char> &packet,T* data,int dataSize)
+inline void unpackv(const std::vector<unsigned char> &packet,size_t &offset,T* data,size_t dataSize)
 {
+	static_assert(isPackable<T>,"unpackv: el tipo debe ser trivialmente copiable");
 	dataSize*=sizeof(T);
-	int packetSize=packet.size();
-	memcpy(data,packet.data(),dataSize);
-	memcpy(packet.data(),packet.data()+dataSize,packetSize-dataSize);
-	packet.resize(packetSize-dataSize);
+	checkUnpack(packet,offset,dataSize);
+	memcpy(data,packet.data()+offset,dataSize);
+	offset+=dataSize;
 }
 
+//llena el rango completo (el llamante fija antes su tamaño)
+template<typename R,typename=std::enable_if_t<contiguousRange<R>::value>>
+inline void unpackv(const std::vector<unsigned char> &packet,size_t &offset,R &range)
+{
+	unpackv(packet,offset,std::data(range),std::size(range));
+}
+
+
+
+//escritura secuencial sobre un paquete: la capacidad se reserva una vez al
+//crearlo y cada write añade los bytes al final sin redimensionar con ceros
+class PacketWriter{
+public:
+	PacketWriter(std::vector<unsigned char> &packet,size_t capacity=0):packet(packet)
+	{
+		packet.reserve(packet.size()+capacity);
+	}
+
+	template<typename T>
+	void write(const T &data)
+	{
+		static_assert(isPackable<T>,"PacketWriter: el tipo debe ser trivialmente copiable");
+		const unsigned char *ptr=(const unsigned char*)&data;
+		packet.insert(packet.end(),ptr,ptr+sizeof(T));
+	}
+
+	template<typename T>
+	void writev(const T* data,size_t dataSize)
+	{
+		packv(packet,data,dataSize);
+	}
+
+	template<typename R,typename=std::enable_if_t<contiguousRange<const R>::value>>
+	void writev(const R &range)
+	{
+		packv(packet,range);
+	}
+
+	//longitud (long int, como la lee readString) y caracteres
+	void writeString(std::string_view str)
+	{
+		write((long int)str.size());
+		writev(str);
+	}
+
+	//entero sin signo en base 128 (1 byte si es menor que 128)
+	void writeVarint(uint64_t value)
+	{
+		unsigned char bytes[MAX_VARINT_BYTES];
+		packet.insert(packet.end(),bytes,bytes+encodeVarint(value,bytes));
+	}
+
+	//longitud varint y caracteres
+	void writeStringV2(std::string_view str)
+	{
+		writeVarint(str.size());
+		writev(str);
+	}
+
+	size_t size() const { return packet.size(); }
+
+private:
+	std::vector<unsigned char> &packet;
+};
+
+
+
+//lectura secuencial de un paquete: avanza un offset sobre el buffer original
+//en vez de mover el resto del paquete. Las vistas apuntan al buffer, así que
+//solo valen mientras este no se modifique
+class PacketReader{
+public:
+	PacketReader(const std::vector<unsigned char> &packet):
+		data(packet.data()),dataSize(packet.size()),offset(0){}
+	PacketReader(const unsigned char* data,size_t dataSize):
+		data(data),dataSize(dataSize),offset(0){}
+
+	template<typename T>
+	T read()
+	{
+		static_assert(isPackable<T>,"PacketReader: el tipo debe ser trivialmente copiable");
+		T value;
+		memcpy(&value,consume(sizeof(T)),sizeof(T));
+		return value;
+	}
+
+	template<typename T>
+	void readv(T* out,size_t numElements)
+	{
+		static_assert(isPackable<T>,"PacketReader: el tipo debe ser trivialmente copiable");
+		memcpy(out,consume(numElements*sizeof(T)),numElements*sizeof(T));
+	}
+
+	//llena el rango completo (el llamante fija antes su tamaño)
+	template<typename R,typename=std::enable_if_t<contiguousRange<R>::value>>
+	void readv(R &range)
+	{
+		readv(std::data(range),std::size(range));
+	}
+
+	//vista de los siguientes bytes sin copiarlos
+	std::string_view view(size_t bytes)
+	{
+		return std::string_view((const char*)consume(bytes),bytes);
+	}
+
+	//longitud (long int) seguida de los caracteres
+	std::string_view readString()
+	{
+		long int len=read<long int>();
+		if(len<0)
+			throw std::out_of_range("PacketReader: longitud negativa");
+		return view(len);
+	}
+
+	uint64_t readVarint()
+	{
+		uint64_t value=0;
+		for(int shift=0;shift<7*MAX_VARINT_BYTES;shift+=7)
+		{
+			unsigned char byte=*consume(1);
+			value|=(uint64_t)(byte&0x7f)<<shift;
+			if(!(byte&0x80))
+				return value;
+		}
+		throw std::out_of_range("PacketReader: varint demasiado largo");
+	}
+
+	//longitud varint seguida de los caracteres
+	std::string_view readStringV2()
+	{
+		return view(readVarint());
+	}
+
+	size_t remaining() const { return dataSize-offset; }
+
+private:
+	const unsigned char* consume(size_t bytes)
+	{
+		if(bytes>dataSize-offset)
+			throw std::out_of_range("PacketReader: paquete truncado");
+		const unsigned char* ptr=data+offset;
+		offset+=bytes;
+		return ptr;
+	}
+
+	const unsigned char* data;
+	size_t dataSize;
+	size_t offset;
+};
+
 #endif
\ No newline at end of file
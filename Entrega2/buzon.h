@@ -0,0 +1,79 @@
+/*
+ * buzon.h - Buzón sin cerrojos de varios productores y un consumidor
+ *
+ * Cualquier hilo deposita elementos con depositar(); solo el hilo dueño los
+ * recoge con recogerTodo(). Los productores apilan nodos con un CAS sobre la
+ * cabeza y el consumidor se lleva la pila entera con un único exchange, así
+ * que no hay ABA ni cerrojos en ningún lado. Al recoger se invierte la pila
+ * para devolver los elementos en orden de llegada (FIFO por productor).
+ */
+
+#ifndef _BUZON_H_
+#define _BUZON_H_
+
+#include <atomic>
+#include <utility>
+#include <vector>
+
+template<typename T>
+class BuzonMPSC {
+
+public:
+    BuzonMPSC() : cabeza(nullptr) {}
+
+    ~BuzonMPSC() {
+        Nodo* nodo = cabeza.load();
+        while (nodo != nullptr) {
+            Nodo* siguiente = nodo->siguiente;
+            delete nodo;
+            nodo = siguiente;
+        }
+    }
+
+    BuzonMPSC(const BuzonMPSC&) = delete;
+    BuzonMPSC& operator=(const BuzonMPSC&) = delete;
+
+    // Puede llamarse desde cualquier hilo. Devuelve true si el buzón estaba
+    // vacío: solo entonces hace falta despertar al consumidor
+    bool depositar(T valor) {
+        Nodo* nodo = new Nodo(std::move(valor));
+        Nodo* anterior = cabeza.load(std::memory_order_relaxed);
+        do {
+            nodo->siguiente = anterior;
+        } while (!cabeza.compare_exchange_weak(anterior, nodo, std::memory_order_release,
+                                               std::memory_order_relaxed));
+        return anterior == nullptr;
+    }
+
+    // Solo desde el hilo consumidor. Añade a destino todo lo depositado
+    void recogerTodo(std::vector<T>& destino) {
+        Nodo* nodo = cabeza.exchange(nullptr, std::memory_order_acquire);
+
+        // Invertir la pila para recuperar el orden de llegada
+        Nodo* invertida = nullptr;
+        while (nodo != nullptr) {
+            Nodo* siguiente = nodo->siguiente;
+            nodo->siguiente = invertida;
+            invertida = nodo;
+            nodo = siguiente;
+        }
+
+        while (invertida != nullptr) {
+            Nodo* siguiente = invertida->siguiente;
+            destino.push_back(std::move(invertida->valor));
+            delete invertida;
+            invertida = siguiente;
+        }
+    }
+
+private:
+    struct Nodo {
+        explicit Nodo(T valor) : valor(std::move(valor)), siguiente(nullptr) {}
+        T valor;
+        Nodo* siguiente;
+    };
+
+    std::atomic<Nodo*> cabeza;
+};
+
+#endif
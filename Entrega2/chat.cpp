@@ -0,0 +1,601 @@
+/*
+ * chat.cpp - Implementación de la lógica de chat compartida
+ */
+
+#include "chat.h"
+#include "registro.h"
+#include "indice.h"
+#include "log.h"
+
+#include <vector>
+#include <map>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace std;
+
+typedef Registro<ConexionPtr> RegistroClientes;
+
+static vector<unique_ptr<RegistroClientes>> crearShards(int numShards) {
+    vector<unique_ptr<RegistroClientes>> shards;
+    for (int i = 0; i < numShards; ++i) {
+        shards.push_back(unique_ptr<RegistroClientes>(new RegistroClientes(MAX_CLIENTES)));
+    }
+    return shards;
+}
+
+// Miembros de una sala en un shard: array compacto que se sustituye entero
+// (copia al escribir) en cada alta o baja. broadcastShard toma la versión
+// actual con atomic_load y la recorre sin el cerrojo de los cambios
+typedef shared_ptr<const vector<ConexionPtr>> MiembrosSala;
+
+struct SalasShard {
+    mutex cambiosMutex;                   // Serializa altas y bajas del shard
+    unique_ptr<MiembrosSala[]> miembros;  // Por ID de sala (vacío: nadie)
+
+    SalasShard() : miembros(new MiembrosSala[MAX_SALAS]) {}
+};
+
+static vector<unique_ptr<SalasShard>> crearSalas(int numShards) {
+    vector<unique_ptr<SalasShard>> salas;
+    for (int i = 0; i < numShards; ++i) {
+        salas.push_back(unique_ptr<SalasShard>(new SalasShard()));
+    }
+    return salas;
+}
+
+// Variables globales para gestión de clientes
+vector<unique_ptr<RegistroClientes>> clientesConectados = crearShards(1);  // Clientes activos por shard
+vector<unique_ptr<SalasShard>> salasPorShard = crearSalas(1);            // Sala -> miembros por shard
+// ID de cliente -> shard y slot en su registro, para los mensajes privados.
+// El slot ocupa los 16 bits bajos del valor
+static_assert(MAX_CLIENTES <= 65536, "el slot no cabe en el índice de clientes");
+unique_ptr<IndiceIds> indiceClientes(new IndiceIds(MAX_CLIENTES));
+RepartoShards* repartoShards = nullptr;   // Entrega de broadcasts entre shards
+atomic<int> contadorClientes(0);         // Contador de IDs de clientes
+
+// Cola de salida por cliente
+size_t capacidadCola = 1024;                  // Mensajes por cliente
+PoliticaCola politicaCola = DESCONECTAR;
+atomic<unsigned long> descartados[3];         // Mensajes perdidos por política
+
+static const int MAX_IOV = 64;                // Mensajes por llamada a sendmsg
+
+// Respuesta fija: se comparte entre todos los ACK en lugar de crearla cada vez
+static const MensajePtr mensajeAck = crearMensaje("Servidor: mensaje recibido correctamente.\n");
+
+// Nombres de sala: solo se consultan al unirse, nunca al difundir
+mutex salasMutex;
+map<string, int> idsSala = {{"general", SALA_GENERAL}};
+vector<string> nombresSala = {"general"};
+
+// Últimos mensajes por sala (nulo: sin historial). El de una sala nueva se
+// crea en obtenerSala, antes de que ningún otro hilo conozca su ID
+static vector<unique_ptr<HistorialSala>> crearHistoriales(size_t bytes) {
+    vector<unique_ptr<HistorialSala>> historiales(MAX_SALAS);
+    if (bytes > 0) {
+        historiales[SALA_GENERAL].reset(new HistorialSala(bytes));
+    }
+    return historiales;
+}
+
+size_t bytesHistorial = 16 * 1024;            // Presupuesto por sala
+vector<unique_ptr<HistorialSala>> historiales = crearHistoriales(bytesHistorial);
+
+int nuevoIdCliente() {
+    return ++contadorClientes;
+}
+
+void configurarHistorial(size_t bytes) {
+    bytesHistorial = bytes;
+    historiales = crearHistoriales(bytes);
+}
+
+void configurarShards(int numShards, RepartoShards* reparto) {
+    clientesConectados = crearShards(numShards);
+    salasPorShard = crearSalas(numShards);
+    indiceClientes.reset(new IndiceIds((size_t)numShards * MAX_CLIENTES));
+    repartoShards = reparto;
+}
+
+// Función para agregar un cliente a la lista global (en su shard).
+// Devuelve false si su shard ha alcanzado MAX_CLIENTES
+bool agregarCliente(const ConexionPtr& conexion) {
+    conexion->slotRegistro = clientesConectados[conexion->shard]->insertar(conexion);
+    if (conexion->slotRegistro < 0) {
+        return false;
+    }
+    indiceClientes->insertar(conexion->id, (uint32_t)conexion->shard << 16 | conexion->slotRegistro);
+    return true;
+}
+
+// Función para eliminar un cliente de la lista global (O(1) por su slot)
+void eliminarCliente(Conexion& conexion) {
+    if (conexion.slotRegistro >= 0) {
+        indiceClientes->eliminar(conexion.id);
+    }
+    clientesConectados[conexion.shard]->eliminar(conexion.slotRegistro);
+    conexion.slotRegistro = -1;
+}
+
+static MiembrosSala miembrosSala(int shard, int sala) {
+    return atomic_load(&salasPorShard[shard]->miembros[sala]);
+}
+
+// Función para hacer broadcast de un mensaje a la sala excepto al emisor.
+// Con reparto cada shard lo entrega desde su propio hilo; los shards sin
+// nadie en la sala ni se despiertan
+void broadcast(const MensajePtr& mensaje, int idEmisor, int sala, uint64_t posicion) {
+    for (size_t shard = 0; shard < salasPorShard.size(); ++shard) {
+        MiembrosSala miembros = miembrosSala(shard, sala);
+        if (!miembros || miembros->empty()) {
+            continue;
+        }
+        if (repartoShards != nullptr) {
+            repartoShards->difundir(shard, mensaje, idEmisor, sala, posicion);
+        } else {
+            broadcastShard(shard, mensaje, idEmisor, sala, posicion);
+        }
+    }
+}
+
+// Recorre solo los miembros de la sala en el shard: no frena altas, bajas ni
+// otros broadcasts
+void broadcastShard(int shard, const MensajePtr& mensaje, int idEmisor, int sala,
+                    uint64_t posicion) {
+    MiembrosSala miembros = miembrosSala(shard, sala);
+    if (!miembros) {
+        return;
+    }
+    for (const ConexionPtr& cliente : *miembros) {
+        if (cliente->id != idEmisor) {
+            enviarACliente(*cliente, mensaje, sala, posicion);
+        }
+    }
+}
+
+int obtenerSala(const string& nombre) {
+    if (nombre.empty() || nombre.size() > MAX_NOMBRE_SALA ||
+        nombre.find_first_of(" \t") != string::npos) {
+        return -1;
+    }
+    lock_guard<mutex> lock(salasMutex);
+    auto it = idsSala.find(nombre);
+    if (it != idsSala.end()) {
+        return it->second;
+    }
+    if (nombresSala.size() >= (size_t)MAX_SALAS) {
+        return -1;
+    }
+    int sala = nombresSala.size();
+    idsSala[nombre] = sala;
+    nombresSala.push_back(nombre);
+    if (bytesHistorial > 0) {
+        historiales[sala].reset(new HistorialSala(bytesHistorial));
+    }
+    return sala;
+}
+
+string nombreSala(int sala) {
+    lock_guard<mutex> lock(salasMutex);
+    return sala >= 0 && (size_t)sala < nombresSala.size() ? nombresSala[sala] : "";
+}
+
+// Copia del array de la sala con o sin la conexión (ptr nulo: quitarla)
+static void actualizarMiembros(SalasShard& salas, int sala, const Conexion& conexion,
+                               const ConexionPtr& ptr) {
+    MiembrosSala actual = atomic_load(&salas.miembros[sala]);
+    vector<ConexionPtr>* nuevos = new vector<ConexionPtr>();
+    nuevos->reserve((actual ? actual->size() : 0) + 1);
+    if (actual) {
+        for (const ConexionPtr& miembro : *actual) {
+            if (miembro.get() != &conexion) {
+                nuevos->push_back(miembro);
+            }
+        }
+    }
+    if (ptr) {
+        nuevos->push_back(ptr);
+    }
+    atomic_store(&salas.miembros[sala], MiembrosSala(nuevos));
+}
+
+void cambiarSala(Conexion& conexion, int sala) {
+    if (sala == conexion.sala) {
+        return;
+    }
+    ConexionPtr ptr;
+    if (sala >= 0 && !clientesConectados[conexion.shard]->obtener(conexion.slotRegistro, ptr)) {
+        return;  // No está registrada: no puede recibir nada
+    }
+
+    SalasShard& salas = *salasPorShard[conexion.shard];
+    lock_guard<mutex> lock(salas.cambiosMutex);
+    if (conexion.sala >= 0) {
+        actualizarMiembros(salas, conexion.sala, conexion, ConexionPtr());
+    }
+    if (sala >= 0) {
+        actualizarMiembros(salas, sala, conexion, ptr);
+    }
+    conexion.sala = sala;
+}
+
+string obtenerListaSalas() {
+    size_t numSalas;
+    {
+        lock_guard<mutex> lock(salasMutex);
+        numSalas = nombresSala.size();
+    }
+    string lista;
+    for (size_t sala = 0; sala < numSalas; ++sala) {
+        size_t total = 0;
+        for (size_t shard = 0; shard < salasPorShard.size(); ++shard) {
+            MiembrosSala miembros = miembrosSala(shard, sala);
+            total += miembros ? miembros->size() : 0;
+        }
+        if (total > 0) {
+            lista += lista.empty() ? "salas: " : ",";
+            lista += nombreSala(sala) + "(" + to_string(total) + ")";
+        }
+    }
+    return lista.empty() ? "salas: ninguna" : lista;
+}
+
+bool buscarCliente(int id, ConexionPtr& conexion) {
+    uint32_t posicion;
+    if (!indiceClientes->buscar(id, posicion)) {
+        return false;
+    }
+    // Entre las dos búsquedas el slot puede haber pasado a otro cliente
+    return clientesConectados[posicion >> 16]->obtener(posicion & 0xffff, conexion) &&
+           conexion->id == id;
+}
+
+// Función para obtener la lista de IDs conectados
+string obtenerListaUsuarios() {
+    string lista;
+    for (const auto& shard : clientesConectados) {
+        shard->recorrer([&lista](int, const ConexionPtr& cliente) {
+            lista += lista.empty() ? "conectados: " : ",";
+            lista += to_string(cliente->id);
+        });
+    }
+    return lista.empty() ? "conectados: ninguno" : lista;
+}
+
+void configurarColaSalida(size_t capacidad, PoliticaCola politica) {
+    capacidadCola = capacidad;
+    politicaCola = politica;
+}
+
+bool politicaDesdeTexto(const string& texto, PoliticaCola& politica) {
+    if (texto == "antiguo") {
+        politica = DESCARTAR_ANTIGUO;
+    } else if (texto == "nuevo") {
+        politica = DESCARTAR_NUEVO;
+    } else if (texto == "desconectar") {
+        politica = DESCONECTAR;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+string textoPolitica(PoliticaCola politica) {
+    switch (politica) {
+        case DESCARTAR_ANTIGUO: return "antiguo";
+        case DESCARTAR_NUEVO: return "nuevo";
+        default: return "desconectar";
+    }
+}
+
+string obtenerEstadisticasCola() {
+    return "descartados: antiguo=" + to_string(descartados[DESCARTAR_ANTIGUO].load()) +
+           " nuevo=" + to_string(descartados[DESCARTAR_NUEVO].load()) +
+           " desconectar=" + to_string(descartados[DESCONECTAR].load()) +
+           " log=" + to_string(logDescartados());
+}
+
+// Aplica la política de cliente lento. Requiere salidaMutex tomado.
+// Devuelve true si aún hay que encolar el mensaje nuevo
+static bool aplicarPolitica(Conexion& conexion) {
+    switch (politicaCola) {
+        case DESCARTAR_ANTIGUO: {
+            // El primer mensaje puede estar a medio escribir: se respeta
+            auto victima = conexion.colaSalida.begin();
+            if (conexion.offsetEnvio > 0) {
+                ++victima;
+            }
+            if (victima == conexion.colaSalida.end()) {
+                descartados[DESCARTAR_ANTIGUO]++;
+                return false;
+            }
+            conexion.colaSalida.erase(victima);
+            descartados[DESCARTAR_ANTIGUO]++;
+            return true;
+        }
+        case DESCARTAR_NUEVO:
+            descartados[DESCARTAR_NUEVO]++;
+            return false;
+        default:
+            // El dueño de la conexión la cierra al ver el socket cerrado
+            descartados[DESCONECTAR] += conexion.colaSalida.size() + 1;
+            conexion.colaSalida.clear();
+            conexion.offsetEnvio = 0;
+            conexion.desbordada = true;
+            shutdown(conexion.socket, SHUT_RDWR);
+            return false;
+    }
+}
+
+// Encola y avisa al backend. Requiere salidaMutex tomado
+static void encolar(Conexion& conexion, const MensajePtr& mensaje) {
+    if (conexion.cerrada || conexion.desbordada || conexion.finSalida) {
+        return;
+    }
+    if (conexion.colaSalida.size() >= capacidadCola && !aplicarPolitica(conexion)) {
+        return;
+    }
+    conexion.colaSalida.push_back(mensaje);
+    if (!conexion.envioProgramado) {
+        conexion.envioProgramado = true;
+        conexion.backend->programarEnvio(conexion);
+    }
+}
+
+void enviarACliente(Conexion& conexion, const string& datos) {
+    enviarACliente(conexion, crearMensaje(datos));
+}
+
+void enviarACliente(Conexion& conexion, const MensajePtr& mensaje) {
+    lock_guard<mutex> lock(conexion.salidaMutex);
+    encolar(conexion, mensaje);
+}
+
+void enviarACliente(Conexion& conexion, const MensajePtr& mensaje, int sala, uint64_t posicion) {
+    lock_guard<mutex> lock(conexion.salidaMutex);
+    if (sala == conexion.salaHistorial) {
+        if (conexion.reteniendo) {
+            conexion.retenidos.push_back(make_pair(mensaje, posicion));
+            return;
+        }
+        if (posicion < conexion.historialHasta) {
+            return;  // Ya le llegó con el historial
+        }
+    }
+    encolar(conexion, mensaje);
+}
+
+int prepararIovecs(const deque<MensajePtr>& cola, size_t offset, struct iovec* iov, int maxIov) {
+    int n = 0;
+    for (auto it = cola.begin(); it != cola.end() && n < maxIov; ++it, ++n) {
+        const string& mensaje = **it;
+        iov[n].iov_base = const_cast<char*>(mensaje.data()) + offset;
+        iov[n].iov_len = mensaje.size() - offset;
+        offset = 0;
+    }
+    return n;
+}
+
+void consumirEnviados(deque<MensajePtr>& cola, size_t& offset, size_t n) {
+    while (n > 0 && !cola.empty()) {
+        size_t restante = cola.front()->size() - offset;
+        if (n < restante) {
+            offset += n;
+            return;
+        }
+        n -= restante;
+        offset = 0;
+        cola.pop_front();
+    }
+}
+
+bool vaciarPendiente(Conexion& conexion) {
+    lock_guard<mutex> lock(conexion.salidaMutex);
+    if (conexion.cerrada || conexion.desbordada) {
+        return false;
+    }
+    struct iovec iov[MAX_IOV];
+    while (!conexion.colaSalida.empty()) {
+        int numIov = prepararIovecs(conexion.colaSalida, conexion.offsetEnvio, iov, MAX_IOV);
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = numIov;
+        ssize_t n = sendmsg(conexion.socket, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Socket lleno: EPOLLOUT avisará; hasta entonces no hace falta
+                // que los nuevos mensajes vuelvan a avisar al reactor
+                return true;
+            }
+            return false;
+        }
+        consumirEnviados(conexion.colaSalida, conexion.offsetEnvio, n);
+    }
+    conexion.envioProgramado = false;
+    return true;
+}
+
+// Entra en la sala y recibe de una vez sus últimos mensajes. Mientras se
+// copia el historial, lo que se difunde en la sala queda retenido; después
+// se encola detrás del historial lo que no iba ya en él. Así no se pierde,
+// repite ni desordena nada aunque haya mensajes a la vez que la entrada
+static void entrarEnSala(Conexion& conexion, int sala) {
+    HistorialSala* historial = historiales[sala].get();
+    if (!historial) {
+        cambiarSala(conexion, sala);
+        return;
+    }
+    {
+        lock_guard<mutex> lock(conexion.salidaMutex);
+        conexion.salaHistorial = sala;
+        conexion.reteniendo = true;
+    }
+    cambiarSala(conexion, sala);
+    string texto;
+    uint64_t hasta = historial->copiar(texto);
+
+    lock_guard<mutex> lock(conexion.salidaMutex);
+    if (!texto.empty()) {
+        encolar(conexion, crearMensaje(move(texto)));
+    }
+    conexion.historialHasta = hasta;
+    conexion.reteniendo = false;
+    for (const auto& retenido : conexion.retenidos) {
+        if (retenido.second >= hasta) {
+            encolar(conexion, retenido.first);
+        }
+    }
+    conexion.retenidos.clear();
+}
+
+bool conectarCliente(const ConexionPtr& conexion) {
+    logEvento(LOG_INFO, EVENTO_CONEXION, conexion->id, conexion->socket);
+
+    // Agregar cliente a la lista global
+    if (!agregarCliente(conexion)) {
+        logEvento(LOG_AVISO, EVENTO_RECHAZO, conexion->id, MAX_CLIENTES);
+        return false;
+    }
+
+    // Entra en la sala general con su historial y se avisa a sus miembros
+    entrarEnSala(*conexion, SALA_GENERAL);
+    broadcast(crearMensaje("cliente " + to_string(conexion->id) + " se ha conectado\n"),
+              conexion->id, SALA_GENERAL);
+    return true;
+}
+
+void desconectarCliente(const ConexionPtr& conexion) {
+    // Limpiar y cerrar. Al volver de eliminarCliente ningún broadcast
+    // conserva la conexión, así que ya se puede cerrar el socket
+    bool registrado = conexion->slotRegistro >= 0;
+    int sala = conexion->sala;
+    cambiarSala(*conexion, -1);
+    eliminarCliente(*conexion);
+    {
+        lock_guard<mutex> lock(conexion->salidaMutex);
+        conexion->cerrada = true;
+        conexion->colaSalida.clear();
+        close(conexion->socket);
+    }
+
+    // Notificar desconexión a otros clientes
+    if (!registrado) {
+        return;
+    }
+    if (sala >= 0) {
+        broadcast(crearMensaje("cliente " + to_string(conexion->id) + " se ha desconectado\n"),
+                  conexion->id, sala);
+    }
+}
+
+// Compara una línea recibida con un comando
+static bool esComando(const char* mensaje, size_t longitud, const char* comando) {
+    return longitud == strlen(comando) && memcmp(mensaje, comando, longitud) == 0;
+}
+
+// Comando con argumento ("comando arg"): deja en argumento el resto de la línea
+static bool esComandoCon(const char* mensaje, size_t longitud, const char* comando,
+                         string& argumento) {
+    size_t n = strlen(comando);
+    if (longitud <= n + 1 || memcmp(mensaje, comando, n) != 0 || mensaje[n] != ' ') {
+        return false;
+    }
+    argumento.assign(mensaje + n + 1, longitud - n - 1);
+    return true;
+}
+
+// Cambia de sala avisando a los miembros de la que deja y de la nueva
+static void moverASala(Conexion& conexion, int sala) {
+    int anterior = conexion.sala;
+    if (sala == anterior) {
+        enviarACliente(conexion, "Servidor: ya estás en la sala " + nombreSala(sala) + "\n");
+        return;
+    }
+    string cliente = "cliente " + to_string(conexion.id);
+    entrarEnSala(conexion, sala);
+    broadcast(crearMensaje(cliente + " ha dejado la sala " + nombreSala(anterior) + "\n"),
+              conexion.id, anterior);
+    broadcast(crearMensaje(cliente + " se ha unido a la sala " + nombreSala(sala) + "\n"),
+              conexion.id, sala);
+    enviarACliente(conexion, "Servidor: ahora estás en la sala " + nombreSala(sala) + "\n");
+}
+
+bool procesarMensaje(Conexion& conexion, const char* mensaje, size_t longitud) {
+    // Registrar el mensaje (lo escribe el hilo de log, no este)
+    logEvento(LOG_INFO, EVENTO_MENSAJE, conexion.id, longitud, mensaje, longitud);
+
+    // Procesar comandos especiales
+    string argumento;
+    if (esComando(mensaje, longitud, "exit")) {
+        // Cliente solicita desconexión
+        enviarACliente(conexion, "Servidor: desconectando...\n");
+        return false;
+    }
+    else if (esComando(mensaje, longitud, "usuarios")) {
+        // Listar usuarios conectados
+        enviarACliente(conexion, obtenerListaUsuarios() + "\n");
+    }
+    else if (esComando(mensaje, longitud, "salas")) {
+        enviarACliente(conexion, obtenerListaSalas() + "\n");
+    }
+    else if (esComandoCon(mensaje, longitud, "unirse", argumento)) {
+        int sala = obtenerSala(argumento);
+        if (sala < 0) {
+            enviarACliente(conexion, "Servidor: nombre de sala no válido o demasiadas salas\n");
+        } else {
+            moverASala(conexion, sala);
+        }
+    }
+    else if (esComandoCon(mensaje, longitud, "privado", argumento)) {
+        // "privado <id> <texto>": solo se encola en la conexión destino
+        size_t espacio = argumento.find(' ');
+        char* fin;
+        long idDestino = strtol(argumento.c_str(), &fin, 10);
+        ConexionPtr destino;
+        if (espacio == string::npos || fin != argumento.c_str() + espacio ||
+            idDestino <= 0 || idDestino != (int)idDestino || !buscarCliente(idDestino, destino)) {
+            enviarACliente(conexion, "Servidor: uso privado <id> <mensaje>, con un cliente conectado\n");
+        } else {
+            string texto = "privado de cliente " + to_string(conexion.id) + ": ";
+            texto.reserve(texto.size() + argumento.size() - espacio);
+            texto.append(argumento, espacio + 1, string::npos);
+            texto += '\n';
+            enviarACliente(*destino, crearMensaje(move(texto)));
+            enviarACliente(conexion, mensajeAck);
+        }
+    }
+    else if (esComando(mensaje, longitud, "abandonar")) {
+        // Vuelve a la sala general
+        moverASala(conexion, SALA_GENERAL);
+    }
+    else if (esComando(mensaje, longitud, "estadisticas")) {
+        // Mensajes perdidos por clientes lentos
+        enviarACliente(conexion, obtenerEstadisticasCola() + "\n");
+    }
+    else {
+        // Mensaje normal: se serializa una vez, directamente desde el buffer
+        // de recepción, se copia al historial de su sala y se comparte con
+        // los demás miembros
+        string texto = "cliente " + to_string(conexion.id) + ": ";
+        texto.reserve(texto.size() + longitud + 1);
+        texto.append(mensaje, longitud);
+        texto += '\n';
+        uint64_t posicion = HistorialSala::SIN_POSICION;
+        if (conexion.sala >= 0 && historiales[conexion.sala]) {
+            posicion = historiales[conexion.sala]->agregar(texto.data(), texto.size());
+        }
+        broadcast(crearMensaje(move(texto)), conexion.id, conexion.sala, posicion);
+
+        // Enviar ACK al emisor
+        enviarACliente(conexion, mensajeAck);
+    }
+    return true;
+}
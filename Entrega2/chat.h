@@ -0,0 +1,195 @@
+/*
+ * chat.h - Lógica de chat compartida por todos los modos del servidor
+ *
+ * Contiene:
+ * - Conexion: estado de un cliente conectado (socket, id y cola de salida)
+ * - Lista global de clientes conectados, repartida en shards (registro.h:
+ *   lectura sin cerrojos). En modo epoll cada reactor tiene su shard
+ * - Salas: cada cliente está en una (al conectarse, "general") y sus mensajes
+ *   solo llegan a los miembros de esa sala. Índice sala -> miembros por shard
+ *   en arrays compactos, así un broadcast cuesta lo que mide la sala
+ * - Historial por sala (historial.h): quien entra recibe de una vez los
+ *   últimos mensajes, hasta un presupuesto fijo de bytes por sala
+ * - broadcast, listado de usuarios y procesado de comandos ("usuarios",
+ *   "salas", "unirse <sala>", "abandonar", "privado <id> <texto>",
+ *   "estadisticas", "exit")
+ *
+ * Todos los modos de E/S (un hilo por cliente, epoll e io_uring) usan estas
+ * funciones, de forma que la semántica del chat es la misma en todos.
+ */
+
+#ifndef _CHAT_H_
+#define _CHAT_H_
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+#include "lineas.h"
+#include "historial.h"
+
+struct Conexion;
+struct iovec;
+
+// Mensaje ya serializado. Se construye una sola vez por broadcast y todas las
+// colas de los destinatarios comparten el mismo objeto (contador de referencias)
+typedef std::shared_ptr<const std::string> MensajePtr;
+
+inline MensajePtr crearMensaje(std::string texto) {
+    return std::make_shared<const std::string>(std::move(texto));
+}
+
+// Backend de E/S dueño de las escrituras de sus conexiones: enviarACliente
+// solo encola el mensaje y el backend es quien vacía la cola en el socket
+// (hilo escritor en modo hilos, reactor epoll o anillo io_uring).
+class BackendEnvio {
+public:
+    virtual ~BackendEnvio() {}
+    // Avisa de que la conexión tiene mensajes nuevos en colaSalida.
+    // Se llama con salidaMutex tomado y solo una vez hasta que el backend
+    // recoja la cola (envioProgramado vuelve a false)
+    virtual void programarEnvio(Conexion& conexion) = 0;
+};
+
+// Entrega de broadcasts entre shards. Sin reparto, broadcast recorre todos los
+// shards desde el hilo que lo llama; con reparto (modo epoll) cada shard recibe
+// el mensaje y lo entrega a sus clientes desde el hilo que lo posee
+class RepartoShards {
+public:
+    virtual ~RepartoShards() {}
+    // Hace llegar el mensaje a los clientes de la sala en el shard (debe
+    // acabar llamando a broadcastShard en el hilo adecuado)
+    virtual void difundir(int shard, const MensajePtr& mensaje, int idEmisor, int sala,
+                          uint64_t posicion) = 0;
+};
+
+// Qué hacer con un cliente lento cuya cola de salida está llena
+enum PoliticaCola {
+    DESCARTAR_ANTIGUO = 0,  // Se pierde el mensaje más antiguo aún no enviado
+    DESCARTAR_NUEVO = 1,    // Se pierde el mensaje que llega
+    DESCONECTAR = 2         // Se desconecta al cliente y se pierde toda su cola
+};
+
+// Estado de un cliente conectado
+struct Conexion {
+    int socket;
+    int id;
+    std::mutex salidaMutex;              // Protege todo lo relativo a la salida
+    std::deque<MensajePtr> colaSalida;   // Mensajes pendientes (acotada)
+    size_t offsetEnvio;                  // Bytes ya escritos del primer mensaje
+    bool cerrada;
+    bool desbordada;                     // Desconectada por la política DESCONECTAR
+    BackendEnvio* backend;
+    bool envioProgramado;                // Ya se ha avisado al backend
+    std::condition_variable hayDatos;    // Modo hilos: despierta al hilo escritor
+    bool finSalida;                      // Modo hilos: el escritor acaba al vaciar la cola
+    int shard;                           // Shard de la lista global al que pertenece
+    int slotRegistro;                    // Posición en su shard (-1 si no está)
+    int sala;                            // Sala actual (-1 hasta conectarCliente)
+    LectorLineas entrada;                // Solo lo usa el hilo que lee del socket
+
+    // Entrada en una sala con historial (con salidaMutex): mientras se copia,
+    // los mensajes de esa sala se retienen; después se descartan los que ya
+    // iban en el historial (posición menor que historialHasta)
+    int salaHistorial;
+    uint64_t historialHasta;
+    bool reteniendo;
+    std::vector<std::pair<MensajePtr, uint64_t>> retenidos;
+
+    Conexion(int socket, int id, BackendEnvio* backend, int shard = 0)
+        : socket(socket), id(id), offsetEnvio(0), cerrada(false), desbordada(false),
+          backend(backend), envioProgramado(false), finSalida(false), shard(shard),
+          slotRegistro(-1), sala(-1), salaHistorial(-1), historialHasta(0), reteniendo(false) {}
+};
+
+typedef std::shared_ptr<Conexion> ConexionPtr;
+
+// Asigna un ID único a un nuevo cliente
+int nuevoIdCliente();
+
+// Máximo de clientes conectados a la vez en cada shard
+const int MAX_CLIENTES = 65536;
+
+// Sala en la que entra todo cliente al conectarse y máximo de salas distintas
+// (los IDs de sala no se reutilizan: una sala vacía sigue existiendo)
+const int SALA_GENERAL = 0;
+const int MAX_SALAS = 1024;
+const size_t MAX_NOMBRE_SALA = 32;
+
+// Bytes de historial por sala (0: sin historial). Antes de aceptar clientes
+void configurarHistorial(size_t bytes);
+
+// Divide la lista global en numShards shards. Debe llamarse antes de aceptar
+// clientes; reparto puede ser nullptr (un solo hilo o modo hilos)
+void configurarShards(int numShards, RepartoShards* reparto);
+
+// Gestión de la lista global de clientes
+bool agregarCliente(const ConexionPtr& conexion);
+void eliminarCliente(Conexion& conexion);
+// posicion: la del mensaje en el historial de la sala, si se guardó en él
+void broadcast(const MensajePtr& mensaje, int idEmisor, int sala,
+               uint64_t posicion = HistorialSala::SIN_POSICION);
+std::string obtenerListaUsuarios();
+
+// Conexión de un cliente por su ID en O(1) y sin cerrojos (índice hash de ID
+// a shard y slot del registro). false si no está conectado
+bool buscarCliente(int id, ConexionPtr& conexion);
+
+// Entrega un broadcast solo a los clientes de la sala en un shard
+void broadcastShard(int shard, const MensajePtr& mensaje, int idEmisor, int sala,
+                    uint64_t posicion);
+
+// ID de la sala con ese nombre; si no existe se crea. -1 si el nombre no es
+// válido o ya hay MAX_SALAS
+int obtenerSala(const std::string& nombre);
+std::string nombreSala(int sala);
+// Pasa la conexión a otra sala (o la saca de la suya con sala = -1). Solo
+// desde el hilo que lee de esa conexión
+void cambiarSala(Conexion& conexion, int sala);
+// Salas con miembros y cuántos tiene cada una
+std::string obtenerListaSalas();
+
+// Cola de salida: capacidad en mensajes y política para clientes lentos
+void configurarColaSalida(size_t capacidad, PoliticaCola politica);
+bool politicaDesdeTexto(const std::string& texto, PoliticaCola& politica);
+std::string textoPolitica(PoliticaCola politica);
+
+// Mensajes perdidos por cada política desde que arrancó el servidor (y
+// entradas de log perdidas)
+std::string obtenerEstadisticasCola();
+
+// Encola un mensaje para un cliente y avisa a su backend. No escribe en el
+// socket. Si la cola está llena se aplica la política configurada
+void enviarACliente(Conexion& conexion, const MensajePtr& mensaje);
+void enviarACliente(Conexion& conexion, const std::string& datos);
+// Mensaje difundido en una sala: no se repite lo que ya le llegó con el
+// historial al entrar en ella
+void enviarACliente(Conexion& conexion, const MensajePtr& mensaje, int sala, uint64_t posicion);
+
+// Escribe en un socket no bloqueante todo lo que admita de la cola, varios
+// mensajes por llamada (writev). Devuelve false si el socket ha fallado
+bool vaciarPendiente(Conexion& conexion);
+
+// Escritura con scatter-gather: rellena iov con los mensajes de la cola a
+// partir de offset bytes del primero (hasta maxIov) y devuelve cuántos usa
+int prepararIovecs(const std::deque<MensajePtr>& cola, size_t offset,
+                   struct iovec* iov, int maxIov);
+
+// Quita de la cola lo que ya se ha escrito (n bytes) y actualiza offset
+void consumirEnviados(std::deque<MensajePtr>& cola, size_t& offset, size_t n);
+
+// Alta y baja de un cliente: registro, mensajes de consola y aviso al resto.
+// conectarCliente devuelve false si no cabe; hay que cerrarlo igualmente
+// con desconectarCliente
+bool conectarCliente(const ConexionPtr& conexion);
+void desconectarCliente(const ConexionPtr& conexion);
+
+// Procesa una línea recibida de un cliente (sin el salto de línea).
+// Devuelve false si el cliente ha pedido desconectarse ("exit")
+bool procesarMensaje(Conexion& conexion, const char* mensaje, size_t longitud);
+
+#endif
@@ -0,0 +1,589 @@
+/*
+ * chat_bench.cpp - Generador de carga y medidor de latencia del chat
+ *
+ * Abre muchas conexiones a la vez contra el servidor y envía mensajes a un
+ * ritmo fijo desde un subconjunto de ellas (emisores). Mide:
+ * - protocolo texto (Entrega2): latencia de entrega de cada broadcast, desde
+ *   que el mensaje debía enviarse hasta que lo recibe cada uno de los demás
+ *   clientes. El mensaje lleva dentro su marca de tiempo, así que emisor y
+ *   receptores deben estar en la misma máquina
+ * - protocolo binario (Entrega1): cada emisor envía un mensaje empaquetado
+ *   (cabecera de tamaño + pack/packv) y mide hasta que el servidor cierra la
+ *   conexión tras procesarlo; después vuelve a conectar
+ *
+ * Los mensajes se marcan con la hora a la que tocaba enviarlos y no con la
+ * hora real de envío, para que un servidor lento no esconda su propia espera
+ * (omisión coordinada).
+ *
+ * El resultado (percentiles de latencia y throughput agregado) se escribe en
+ * JSON para poder comparar ejecuciones.
+ *
+ * Uso: ./chat_bench [--host IP] [--puerto N] [--protocolo texto|binario]
+ *                   [--clientes N] [--emisores N] [--tasa mensajes/s]
+ *                   [--tamano bytes] [--duracion s] [--hilos N] [--salida archivo]
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char MARCA[] = "~B";              // Precede a la marca de tiempo en el texto
+static const uint64_t GRACIA_NS = 2000000000ULL;  // Espera final a los mensajes en vuelo
+
+struct Configuracion {
+    string host;
+    int puerto;
+    bool binario;
+    int clientes;
+    int emisores;
+    double tasa;        // Mensajes por segundo entre todos los emisores
+    int tamano;         // Bytes de cada mensaje
+    double duracion;    // Segundos enviando
+    int hilos;
+    string salida;      // Archivo JSON (vacío: salida estándar)
+};
+
+static uint64_t ahoraNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// Histograma logarítmico de latencias en nanosegundos: 64 cubos por cada
+// potencia de dos (error < 1.6%) sin guardar cada muestra
+class Histograma {
+
+public:
+    Histograma() : cubos(64 + 58 * 64, 0), total(0), suma(0), maximo(0) {}
+
+    void anadir(uint64_t valor) {
+        cubos[indice(valor)]++;
+        total++;
+        suma += valor;
+        maximo = max(maximo, valor);
+    }
+
+    void combinar(const Histograma& otro) {
+        for (size_t i = 0; i < cubos.size(); ++i) {
+            cubos[i] += otro.cubos[i];
+        }
+        total += otro.total;
+        suma += otro.suma;
+        maximo = max(maximo, otro.maximo);
+    }
+
+    // Valor por debajo del cual queda la fracción p de las muestras
+    uint64_t percentil(double p) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t objetivo = static_cast<uint64_t>(p * total);
+        if (objetivo >= total) {
+            objetivo = total - 1;
+        }
+        uint64_t acumulado = 0;
+        for (size_t i = 0; i < cubos.size(); ++i) {
+            acumulado += cubos[i];
+            if (acumulado > objetivo) {
+                return min(valorCubo(i), maximo);
+            }
+        }
+        return maximo;
+    }
+
+    uint64_t muestras() const { return total; }
+    uint64_t maximoValor() const { return maximo; }
+    double media() const { return total ? static_cast<double>(suma) / total : 0.0; }
+
+private:
+    vector<uint64_t> cubos;
+    uint64_t total;
+    uint64_t suma;
+    uint64_t maximo;
+
+    static size_t indice(uint64_t valor) {
+        if (valor < 64) {
+            return valor;
+        }
+        int exponente = 63 - __builtin_clzll(valor);    // >= 6
+        uint64_t mantisa = valor >> (exponente - 6);    // [64, 127]
+        return 64 + (exponente - 6) * 64 + (mantisa - 64);
+    }
+
+    // Punto medio del cubo
+    static uint64_t valorCubo(size_t i) {
+        if (i < 64) {
+            return i;
+        }
+        int exponente = (i - 64) / 64 + 6;
+        uint64_t mantisa = (i - 64) % 64 + 64;
+        uint64_t ancho = 1ULL << (exponente - 6);
+        return (mantisa << (exponente - 6)) + ancho / 2;
+    }
+};
+
+struct ClienteBench {
+    int socket;
+    bool emisor;
+    string entrada;         // Línea recibida a medias
+    string salida;          // Bytes pendientes de enviar
+    bool esperandoSalida;   // Registrado con EPOLLOUT
+    uint64_t enVuelo;       // Binario: marca del mensaje sin respuesta (0 = libre)
+};
+
+struct Resultados {
+    uint64_t enviados;
+    uint64_t omitidos;          // Binario: no había emisor libre a su hora
+    uint64_t recibidos;         // Entregas medidas
+    uint64_t bytesRecibidos;
+    uint64_t desconexiones;     // Cierres inesperados del servidor
+    uint64_t erroresConexion;
+    Histograma latencias;
+
+    Resultados() : enviados(0), omitidos(0), recibidos(0), bytesRecibidos(0),
+                   desconexiones(0), erroresConexion(0) {}
+};
+
+static struct sockaddr_in direccionServidor;
+
+// Conexión bloqueante; el socket queda no bloqueante. Devuelve -1 si falla
+static int conectar() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&direccionServidor, sizeof(direccionServidor)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int uno = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &uno, sizeof(uno));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+class HiloBench {
+
+public:
+    explicit HiloBench(const Configuracion& config)
+        : config(config), inicio(0), siguienteEmisor(0) {
+        epollFd = epoll_create1(0);
+    }
+
+    ~HiloBench() {
+        for (ClienteBench& cliente : clientes) {
+            if (cliente.socket >= 0) {
+                close(cliente.socket);
+            }
+        }
+        close(epollFd);
+    }
+
+    // Solo antes de ejecutar: abre la conexión de un cliente de este hilo
+    bool anadirCliente(bool emisor) {
+        ClienteBench cliente;
+        cliente.socket = conectar();
+        cliente.emisor = emisor;
+        cliente.esperandoSalida = false;
+        cliente.enVuelo = 0;
+        if (cliente.socket < 0) {
+            resultados.erroresConexion++;
+            return false;
+        }
+        clientes.push_back(cliente);
+        return true;
+    }
+
+    // Envía desde inicio durante config.duracion y espera a lo que quede en vuelo
+    void ejecutar(uint64_t inicioEnvio) {
+        inicio = inicioEnvio;
+        for (size_t i = 0; i < clientes.size(); ++i) {
+            registrar(i);
+            if (clientes[i].emisor) {
+                emisores.push_back(i);
+            }
+        }
+
+        // Este hilo genera la parte de la tasa que le toca por sus emisores
+        uint64_t intervalo = 0;
+        if (!emisores.empty()) {
+            double tasaHilo = config.tasa * emisores.size() / config.emisores;
+            intervalo = static_cast<uint64_t>(1e9 / tasaHilo);
+        }
+        uint64_t finEnvio = inicio + static_cast<uint64_t>(config.duracion * 1e9);
+        uint64_t fin = finEnvio + GRACIA_NS;
+        uint64_t proximo = inicio;
+
+        struct epoll_event eventos[256];
+        while (true) {
+            uint64_t ahora = ahoraNs();
+            if (ahora >= fin) {
+                break;
+            }
+
+            if (intervalo > 0 && ahora >= inicio && ahora < finEnvio) {
+                while (proximo <= ahora && proximo < finEnvio) {
+                    enviar(proximo);
+                    proximo += intervalo;
+                }
+            }
+
+            int esperaMs = 10;
+            if (intervalo > 0 && proximo < finEnvio) {
+                uint64_t hasta = proximo > ahora ? proximo - ahora : 0;
+                esperaMs = static_cast<int>(hasta / 1000000);
+            }
+            int n = epoll_wait(epollFd, eventos, 256, esperaMs);
+            for (int i = 0; i < n; ++i) {
+                size_t indice = eventos[i].data.u64;
+                if (eventos[i].events & EPOLLOUT) {
+                    escribir(indice);
+                }
+                if (eventos[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                    leer(indice, ahoraNs());
+                }
+            }
+        }
+    }
+
+    Resultados resultados;
+
+private:
+    const Configuracion& config;
+    uint64_t inicio;
+    int epollFd;
+    vector<ClienteBench> clientes;
+    vector<size_t> emisores;
+    size_t siguienteEmisor;
+    char bufferLectura[65536];
+
+    void registrar(size_t indice) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = indice;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, clientes[indice].socket, &ev);
+    }
+
+    void cerrar(size_t indice) {
+        ClienteBench& cliente = clientes[indice];
+        close(cliente.socket);  // También lo saca del epoll
+        cliente.socket = -1;
+        cliente.entrada.clear();
+        cliente.salida.clear();
+        cliente.esperandoSalida = false;
+        cliente.enVuelo = 0;
+    }
+
+    // Construye el mensaje de un emisor marcado con la hora prevista
+    string crearMensaje(uint64_t marca) {
+        string texto = MARCA + to_string(marca) + ":";
+        size_t cuerpo = config.binario ? config.tamano : config.tamano - 1;  // '\n' en texto
+        if (texto.size() < cuerpo) {
+            texto.append(cuerpo - texto.size(), 'x');
+        }
+        if (!config.binario) {
+            texto += '\n';
+            return texto;
+        }
+
+        // Trama de Entrega1: tamaño del buffer y buffer = pack(int) + packv(char)
+        int longitud = texto.size();
+        int tamBuffer = sizeof(int) + longitud;
+        string trama(reinterpret_cast<const char*>(&tamBuffer), sizeof(int));
+        trama.append(reinterpret_cast<const char*>(&longitud), sizeof(int));
+        trama += texto;
+        return trama;
+    }
+
+    void enviar(uint64_t marca) {
+        size_t indice = 0;
+        bool encontrado = false;
+        for (size_t intento = 0; intento < emisores.size(); ++intento) {
+            indice = emisores[siguienteEmisor++ % emisores.size()];
+            // En binario cada conexión lleva un solo mensaje cada vez
+            if (!config.binario || clientes[indice].enVuelo == 0) {
+                encontrado = true;
+                break;
+            }
+        }
+        if (!encontrado) {
+            resultados.omitidos++;
+            return;
+        }
+
+        ClienteBench& cliente = clientes[indice];
+        if (cliente.socket < 0) {
+            cliente.socket = conectar();
+            if (cliente.socket < 0) {
+                resultados.erroresConexion++;
+                return;
+            }
+            registrar(indice);
+        }
+
+        cliente.salida += crearMensaje(marca);
+        cliente.enVuelo = marca;
+        resultados.enviados++;
+        escribir(indice);
+    }
+
+    void escribir(size_t indice) {
+        ClienteBench& cliente = clientes[indice];
+        while (!cliente.salida.empty()) {
+            ssize_t n = send(cliente.socket, cliente.salida.data(), cliente.salida.size(), MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                resultados.desconexiones++;
+                cerrar(indice);
+                return;
+            }
+            cliente.salida.erase(0, n);
+        }
+
+        // EPOLLOUT solo mientras quede algo por enviar
+        bool esperar = !cliente.salida.empty();
+        if (esperar != cliente.esperandoSalida) {
+            struct epoll_event ev;
+            ev.events = esperar ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+            ev.data.u64 = indice;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, cliente.socket, &ev);
+            cliente.esperandoSalida = esperar;
+        }
+    }
+
+    void leer(size_t indice, uint64_t ahora) {
+        ClienteBench& cliente = clientes[indice];
+        while (cliente.socket >= 0) {
+            ssize_t n = recv(cliente.socket, bufferLectura, sizeof(bufferLectura), 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            }
+            if (n <= 0) {
+                if (config.binario && cliente.enVuelo != 0) {
+                    // Entrega1 cierra la conexión al terminar con el mensaje
+                    resultados.latencias.anadir(ahora - cliente.enVuelo);
+                    resultados.recibidos++;
+                } else {
+                    resultados.desconexiones++;
+                }
+                cerrar(indice);
+                return;
+            }
+            resultados.bytesRecibidos += n;
+            if (!config.binario) {
+                procesarLineas(cliente, bufferLectura, n, ahora);
+            }
+        }
+    }
+
+    void procesarLineas(ClienteBench& cliente, const char* datos, size_t n, uint64_t ahora) {
+        const char* fin = datos + n;
+        while (datos < fin) {
+            const char* nl = static_cast<const char*>(memchr(datos, '\n', fin - datos));
+            if (nl == nullptr) {
+                cliente.entrada.append(datos, fin - datos);
+                return;
+            }
+            if (cliente.entrada.empty()) {
+                medirLinea(datos, nl - datos, ahora);
+            } else {
+                cliente.entrada.append(datos, nl - datos);
+                medirLinea(cliente.entrada.data(), cliente.entrada.size(), ahora);
+                cliente.entrada.clear();
+            }
+            datos = nl + 1;
+        }
+    }
+
+    // Solo cuentan los broadcasts de los emisores (llevan la marca)
+    void medirLinea(const char* linea, size_t longitud, uint64_t ahora) {
+        const char* marca = static_cast<const char*>(memmem(linea, longitud, MARCA, sizeof(MARCA) - 1));
+        if (marca == nullptr) {
+            return;
+        }
+        const char* p = marca + sizeof(MARCA) - 1;
+        const char* fin = linea + longitud;
+        uint64_t enviado = 0;
+        while (p < fin && *p >= '0' && *p <= '9') {
+            enviado = enviado * 10 + (*p - '0');
+            ++p;
+        }
+        resultados.latencias.anadir(ahora > enviado ? ahora - enviado : 0);
+        resultados.recibidos++;
+    }
+};
+
+static void usoYSalir() {
+    cerr << "Uso: ./chat_bench [--host IP] [--puerto N] [--protocolo texto|binario]" << endl
+         << "                  [--clientes N] [--emisores N] [--tasa mensajes/s]" << endl
+         << "                  [--tamano bytes] [--duracion s] [--hilos N] [--salida archivo]" << endl;
+    exit(1);
+}
+
+// Los miles de sockets necesitan subir el límite de descriptores
+static void subirLimiteDescriptores() {
+    struct rlimit limite;
+    if (getrlimit(RLIMIT_NOFILE, &limite) == 0 && limite.rlim_cur < limite.rlim_max) {
+        limite.rlim_cur = limite.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limite);
+    }
+}
+
+static string generarJson(const Configuracion& config, const Resultados& total, double segundos) {
+    ostringstream json;
+    json.setf(ios::fixed);
+    json.precision(1);
+    json << "{\n"
+         << "  \"protocolo\": \"" << (config.binario ? "binario" : "texto") << "\",\n"
+         << "  \"host\": \"" << config.host << "\",\n"
+         << "  \"puerto\": " << config.puerto << ",\n"
+         << "  \"clientes\": " << config.clientes << ",\n"
+         << "  \"emisores\": " << config.emisores << ",\n"
+         << "  \"tasa_objetivo\": " << config.tasa << ",\n"
+         << "  \"tamano\": " << config.tamano << ",\n"
+         << "  \"duracion_s\": " << config.duracion << ",\n"
+         << "  \"hilos\": " << config.hilos << ",\n"
+         << "  \"enviados\": " << total.enviados << ",\n"
+         << "  \"omitidos\": " << total.omitidos << ",\n"
+         << "  \"recibidos\": " << total.recibidos << ",\n"
+         << "  \"bytes_recibidos\": " << total.bytesRecibidos << ",\n"
+         << "  \"desconexiones\": " << total.desconexiones << ",\n"
+         << "  \"errores_conexion\": " << total.erroresConexion << ",\n"
+         << "  \"throughput_envio_msg_s\": " << total.enviados / segundos << ",\n"
+         << "  \"throughput_entrega_msg_s\": " << total.recibidos / segundos << ",\n"
+         << "  \"throughput_bytes_s\": " << total.bytesRecibidos / segundos << ",\n"
+         << "  \"latencia_us\": {\n"
+         << "    \"p50\": " << total.latencias.percentil(0.50) / 1000.0 << ",\n"
+         << "    \"p99\": " << total.latencias.percentil(0.99) / 1000.0 << ",\n"
+         << "    \"p999\": " << total.latencias.percentil(0.999) / 1000.0 << ",\n"
+         << "    \"max\": " << total.latencias.maximoValor() / 1000.0 << ",\n"
+         << "    \"media\": " << total.latencias.media() / 1000.0 << "\n"
+         << "  }\n"
+         << "}\n";
+    return json.str();
+}
+
+int main(int argc, char** argv) {
+    Configuracion config;
+    config.host = "127.0.0.1";
+    config.puerto = 5000;
+    config.binario = false;
+    config.clientes = 1000;
+    config.emisores = 10;
+    config.tasa = 1000;
+    config.tamano = 64;
+    config.duracion = 10;
+    config.hilos = 4;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            usoYSalir();
+        }
+        string valor = argv[++i];
+        if (arg == "--host") config.host = valor;
+        else if (arg == "--puerto") config.puerto = atoi(valor.c_str());
+        else if (arg == "--protocolo") config.binario = (valor == "binario");
+        else if (arg == "--clientes") config.clientes = atoi(valor.c_str());
+        else if (arg == "--emisores") config.emisores = atoi(valor.c_str());
+        else if (arg == "--tasa") config.tasa = atof(valor.c_str());
+        else if (arg == "--tamano") config.tamano = atoi(valor.c_str());
+        else if (arg == "--duracion") config.duracion = atof(valor.c_str());
+        else if (arg == "--hilos") config.hilos = atoi(valor.c_str());
+        else if (arg == "--salida") config.salida = valor;
+        else usoYSalir();
+    }
+    if (config.clientes <= 0 || config.emisores <= 0 || config.tasa <= 0 ||
+        config.tamano <= 0 || config.duracion <= 0 || config.hilos <= 0) {
+        usoYSalir();
+    }
+    config.emisores = min(config.emisores, config.clientes);
+    config.hilos = min(config.hilos, config.clientes);
+
+    direccionServidor.sin_family = AF_INET;
+    direccionServidor.sin_port = htons(config.puerto);
+    if (inet_pton(AF_INET, config.host.c_str(), &direccionServidor.sin_addr) <= 0) {
+        cerr << "Dirección IP inválida: " << config.host << endl;
+        return 1;
+    }
+    subirLimiteDescriptores();
+
+    // Conectar todos los clientes antes de empezar. Los emisores se reparten
+    // por turnos entre los hilos para que todos generen carga
+    vector<HiloBench*> hilos;
+    for (int h = 0; h < config.hilos; ++h) {
+        hilos.push_back(new HiloBench(config));
+    }
+    int paso = config.clientes / config.emisores;
+    int conectados = 0;
+    int numEmisor = 0;
+    for (int i = 0; i < config.clientes; ++i) {
+        bool emisor = i % paso == 0 && i / paso < config.emisores;
+        int hilo = emisor ? numEmisor++ % config.hilos : i % config.hilos;
+        if (hilos[hilo]->anadirCliente(emisor)) {
+            conectados++;
+        }
+    }
+    cerr << "[BENCH] " << conectados << "/" << config.clientes << " clientes conectados" << endl;
+
+    // Margen para que el servidor reparta los avisos de conexión
+    uint64_t inicio = ahoraNs() + 500000000ULL;
+    vector<thread> ejecucion;
+    for (HiloBench* hilo : hilos) {
+        ejecucion.push_back(thread([hilo, inicio]() {
+            hilo->ejecutar(inicio);
+        }));
+    }
+    for (thread& t : ejecucion) {
+        t.join();
+    }
+
+    Resultados total;
+    for (HiloBench* hilo : hilos) {
+        const Resultados& r = hilo->resultados;
+        total.enviados += r.enviados;
+        total.omitidos += r.omitidos;
+        total.recibidos += r.recibidos;
+        total.bytesRecibidos += r.bytesRecibidos;
+        total.desconexiones += r.desconexiones;
+        total.erroresConexion += r.erroresConexion;
+        total.latencias.combinar(r.latencias);
+        delete hilo;
+    }
+
+    string json = generarJson(config, total, config.duracion);
+    if (config.salida.empty()) {
+        cout << json;
+    } else {
+        ofstream archivo(config.salida.c_str());
+        archivo << json;
+        if (!archivo) {
+            cerr << "No se pudo escribir " << config.salida << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -5,7 +5,9 @@
  * - Conecta a un servidor TCP (IP y puerto configurables)
  * - Envía mensajes del usuario al servidor
  * - Recibe y muestra respuestas y broadcasts del servidor
- * - Comandos especiales: "usuarios" (lista clientes), "exit" (desconectar)
+ * - Comandos especiales: "usuarios" (lista clientes), "salas", "unirse <sala>",
+ *   "abandonar" (volver a la sala general), "privado <id> <mensaje>",
+ *   "exit" (desconectar)
  */
 
 #include <iostream>
@@ -99,6 +101,9 @@ int main(int argc, char** argv) {
     cout << "Comandos disponibles:" << endl;
     cout << "  - Escribe un mensaje para enviarlo" << endl;
     cout << "  - 'usuarios' para ver clientes conectados" << endl;
+    cout << "  - 'salas' para ver las salas con gente" << endl;
+    cout << "  - 'unirse <sala>' para cambiar de sala, 'abandonar' para volver a general" << endl;
+    cout << "  - 'privado <id> <mensaje>' para escribir solo a un cliente" << endl;
     cout << "  - 'exit' para desconectar" << endl;
     cout << "========================================" << endl << endl;
 
@@ -19,20 +19,30 @@ void clientManager::enviaMensaje(int id, string mensaje)
 	//recibir respuesta
 		//limpiar buffer
 	//consultar ack
-	while(bufferAcks.size()==0) usleep(100); //espera semidurmiente
-	//leer ack
+	esperaAck();
+}
+
+void clientManager::esperaAck()
+{
+	while(bufferAcks.size()==bufferAcksLeidos) usleep(100); //espera semidurmiente
+	//leer ack: la cola avanza un offset y se vacía cuando se ha leído entera
 	cerrojoBuffers.lock();
-	if(unpack<int>(bufferAcks)!= ack)
+	if(unpack<int>(bufferAcks,bufferAcksLeidos)!= ack)
 		cout<<"Error enviando mensaje\n";
+	if(bufferAcksLeidos==bufferAcks.size())
+	{
+		bufferAcks.clear();
+		bufferAcksLeidos=0;
+	}
 	cerrojoBuffers.unlock();
 }
 
-string clientManager::desempaquetaTipoTexto(vector<unsigned char> &buffer){
+string clientManager::desempaquetaTipoTexto(const vector<unsigned char> &buffer, size_t &offset){
 
 	string mensaje;
 	//para crear un paquete de datos
-	mensaje.resize(unpack<long int>(buffer));
-	unpackv(buffer,(char*)mensaje.data(),mensaje.size());
+	mensaje.resize(unpack<long int>(buffer,offset));
+	unpackv(buffer,offset,(char*)mensaje.data(),mensaje.size());
 	return mensaje;
 }
 
@@ -49,12 +59,7 @@ void clientManager::enviaLogin(int id, string userName){
 	//enviar
 	sendMSG(id,buffer);
 	//consultar ack
-	while(bufferAcks.size()==0) usleep(100); //espera semidurmiente
-	//leer ack
-	cerrojoBuffers.lock();
-	if(unpack<int>(bufferAcks)!= ack)
-		cout<<"Error enviando mensaje\n";
-	cerrojoBuffers.unlock();
+	esperaAck();
 
 }
 
@@ -67,14 +72,15 @@ void clientManager::atiendeCliente(int clientID)
 	while(!salir){
 		//recibe paquete datos
 		recvMSG(clientID,bufferIn);
+		size_t offset=0;
 		//desempaquetar tipo paquete
-		msgTypes type=unpack<msgTypes>(bufferIn);
+		msgTypes type=unpack<msgTypes>(bufferIn,offset);
 		//dependiendo de tipo
 		switch(type){
 			//tipo texto
 			case texto:{
 				//desempaquetar mensaje
-				string msg=desempaquetaTipoTexto(bufferIn);
+				string msg=desempaquetaTipoTexto(bufferIn,offset);
 				//reenviar
 				reenviaTexto(userName,msg);
 			}break;
@@ -87,7 +93,7 @@ void clientManager::atiendeCliente(int clientID)
 			}break;//tipo login
 			case login:{
 				//desempaquetar usuario
-				userName=desempaquetaTipoTexto(bufferIn);
+				userName=desempaquetaTipoTexto(bufferIn,offset);
 				//añadir si no existe
 				if(connectionIds.find(userName)==connectionIds.end())
 					connectionIds[userName]=clientID;
@@ -142,13 +148,14 @@ string clientManager::recibeMensaje(int serverId){
     vector<unsigned char> buffer;
 
 	recvMSG(serverId,buffer);
+	size_t offset=0;
 	//desempaquetar mensaje reenviado
 		//desepaquetar tipo
-	msgTypes type=unpack<msgTypes>(buffer);
+	msgTypes type=unpack<msgTypes>(buffer,offset);
 		//username
-	userName=desempaquetaTipoTexto(buffer);
+	userName=desempaquetaTipoTexto(buffer,offset);
 		//mensaje
-	mensaje=desempaquetaTipoTexto(buffer);
+	mensaje=desempaquetaTipoTexto(buffer,offset);
 
 	return userName+":"+mensaje;
 
@@ -25,11 +25,13 @@ public:
 	//recepción asincrona de paquetes en cliente
 	static inline mutex cerrojoBuffers;
 	static inline vector<unsigned char> bufferAcks;
+	static inline size_t bufferAcksLeidos=0;   //bytes de bufferAcks ya leídos
 	static inline vector<unsigned char> bufferTxt;
 
 	static inline map<string,int> connectionIds;
 	static void enviaMensaje(int id, string mensaje);
-	static string desempaquetaTipoTexto(vector<unsigned char> &buffer);
+	static string desempaquetaTipoTexto(const vector<unsigned char> &buffer, size_t &offset);
+	static void esperaAck();
 	static void enviaLogin(int id, string userName);
 	static void atiendeCliente(int clientId);
 	static string recibeMensaje(int serverId);
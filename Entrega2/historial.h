@@ -0,0 +1,104 @@
+/*
+ * historial.h - Últimos mensajes de una sala en un anillo de bytes
+ *
+ * Un único buffer de capacidad fija (el presupuesto en bytes de la sala).
+ * Cada mensaje ocupa una cabecera con su longitud seguida de sus bytes, y
+ * los nuevos pisan a los más antiguos al dar la vuelta: guardar un mensaje
+ * no reserva memoria. Las posiciones son absolutas (bytes escritos desde el
+ * inicio), así que también sirven para ordenar los mensajes.
+ *
+ * Un mutex por sala protege el anillo. Guardar es una copia corta que se
+ * hace antes de la difusión y fuera de ella (la difusión no lo toma), y
+ * copiar el historial solo ocurre al entrar en la sala. Con el cerrojo, lo
+ * que ve un lector son siempre mensajes completos: primero apunta a la
+ * cabecera del más antiguo y fin al final del último.
+ */
+
+#ifndef _HISTORIAL_H_
+#define _HISTORIAL_H_
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class HistorialSala {
+
+public:
+    // Posición de un mensaje que no está en el historial
+    static const uint64_t SIN_POSICION = UINT64_MAX;
+
+    explicit HistorialSala(size_t bytes)
+        : capacidad(bytes > CABECERA ? bytes : CABECERA + 1), buffer(new char[capacidad]),
+          primero(0), fin(0) {}
+
+    HistorialSala(const HistorialSala&) = delete;
+    HistorialSala& operator=(const HistorialSala&) = delete;
+
+    // Guarda un mensaje y devuelve su posición, o SIN_POSICION si no cabe
+    uint64_t agregar(const char* datos, size_t n) {
+        if (n == 0 || n > UINT32_MAX || CABECERA + n > capacidad) {
+            return SIN_POSICION;
+        }
+        std::lock_guard<std::mutex> lock(cerrojo);
+        // Se descartan los más antiguos hasta que quepa entero
+        while (fin + CABECERA + n - primero > capacidad) {
+            primero += CABECERA + longitud(primero);
+        }
+        uint64_t posicion = fin;
+        uint32_t longitudMensaje = static_cast<uint32_t>(n);
+        escribir(fin, reinterpret_cast<const char*>(&longitudMensaje), CABECERA);
+        escribir(fin + CABECERA, datos, n);
+        fin += CABECERA + n;
+        return posicion;
+    }
+
+    // Añade a salida los mensajes guardados, del más antiguo al más reciente,
+    // y devuelve la posición siguiente al último: todo mensaje con posición
+    // menor va incluido (o ya se había perdido por antiguo)
+    uint64_t copiar(std::string& salida) const {
+        std::lock_guard<std::mutex> lock(cerrojo);
+        salida.reserve(salida.size() + (fin - primero));
+        for (uint64_t p = primero; p < fin; ) {
+            size_t n = longitud(p);
+            size_t anterior = salida.size();
+            salida.resize(anterior + n);
+            leer(p + CABECERA, &salida[anterior], n);
+            p += CABECERA + n;
+        }
+        return fin;
+    }
+
+private:
+    static const size_t CABECERA = sizeof(uint32_t);
+
+    size_t longitud(uint64_t posicion) const {
+        uint32_t n;
+        leer(posicion, reinterpret_cast<char*>(&n), CABECERA);
+        return n;
+    }
+
+    // Copias que pueden dar la vuelta al final del buffer
+    void escribir(uint64_t posicion, const char* datos, size_t n) {
+        size_t inicio = posicion % capacidad;
+        size_t primeraParte = capacidad - inicio < n ? capacidad - inicio : n;
+        memcpy(buffer.get() + inicio, datos, primeraParte);
+        memcpy(buffer.get(), datos + primeraParte, n - primeraParte);
+    }
+
+    void leer(uint64_t posicion, char* destino, size_t n) const {
+        size_t inicio = posicion % capacidad;
+        size_t primeraParte = capacidad - inicio < n ? capacidad - inicio : n;
+        memcpy(destino, buffer.get() + inicio, primeraParte);
+        memcpy(destino + primeraParte, buffer.get(), n - primeraParte);
+    }
+
+    const size_t capacidad;
+    std::unique_ptr<char[]> buffer;
+    mutable std::mutex cerrojo;
+    uint64_t primero;       // Cabecera del mensaje más antiguo guardado
+    uint64_t fin;           // Final del último mensaje
+};
+
+#endif
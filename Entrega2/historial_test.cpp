@@ -0,0 +1,176 @@
+/*
+ * historial_test.cpp - Pruebas del historial por sala (historial.h)
+ *
+ * - Casos básicos: orden, descarte de los más antiguos al dar la vuelta,
+ *   mensajes que no caben y posición devuelta por copiar
+ * - Concurrencia: varios hilos guardan líneas numeradas mientras otros
+ *   copian el historial sin parar. Cada copia debe estar formada solo por
+ *   líneas completas, con los números de cada escritor en orden creciente,
+ *   y la posición que devuelve copiar no puede retroceder. Al final, el
+ *   último mensaje guardado cierra la copia y esta llena casi todo el
+ *   presupuesto
+ *
+ * Devuelve 0 si todo es correcto; si no, muestra los fallos y devuelve 1.
+ *
+ * Uso: ./historial_test [escrituras por hilo, por defecto 20000]
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+#include "historial.h"
+
+using namespace std;
+
+static int fallos = 0;
+
+static void comprobar(bool condicion, const string& descripcion) {
+    if (!condicion) {
+        cerr << "FALLO: " << descripcion << endl;
+        fallos++;
+    }
+}
+
+static void probarBasico() {
+    HistorialSala historial(64);
+    string copia;
+    comprobar(historial.copiar(copia) == 0 && copia.empty(), "historial vacío");
+
+    uint64_t a = historial.agregar("uno\n", 4);
+    uint64_t b = historial.agregar("dos\n", 4);
+    comprobar(a == 0 && b > a, "posiciones crecientes");
+    uint64_t hasta = historial.copiar(copia);
+    comprobar(copia == "uno\ndos\n", "copia en orden");
+    comprobar(hasta > b, "copiar devuelve el final del último mensaje");
+
+    // Al dar varias vueltas solo quedan mensajes enteros, los más recientes
+    for (int i = 0; i < 100; ++i) {
+        string linea = "linea " + to_string(i) + "\n";
+        historial.agregar(linea.data(), linea.size());
+    }
+    copia.clear();
+    historial.copiar(copia);
+    comprobar(copia.size() <= 64, "la copia no supera el presupuesto");
+    comprobar(copia.compare(0, 5, "linea") == 0, "la copia empieza en un mensaje entero");
+    comprobar(copia.size() >= 9 && copia.compare(copia.size() - 9, 9, "linea 99\n") == 0,
+              "el último mensaje está en la copia");
+
+    string grande(100, 'x');
+    comprobar(historial.agregar(grande.data(), grande.size()) == HistorialSala::SIN_POSICION,
+              "un mensaje mayor que el presupuesto no se guarda");
+    comprobar(historial.agregar("", 0) == HistorialSala::SIN_POSICION,
+              "un mensaje vacío no se guarda");
+}
+
+// Línea "w<escritor>-<número>-<relleno>\n"; el relleno varía la longitud
+static string lineaEscritor(int escritor, int numero) {
+    return "w" + to_string(escritor) + "-" + to_string(numero) + "-" +
+           string(numero % 23, 'y') + "\n";
+}
+
+// Comprueba una copia: solo líneas completas y bien formadas, y los números
+// de cada escritor en orden creciente
+static bool copiaCorrecta(const string& copia, int numEscritores) {
+    vector<int> ultimo(numEscritores, -1);
+    size_t p = 0;
+    while (p < copia.size()) {
+        size_t nl = copia.find('\n', p);
+        if (nl == string::npos) {
+            return false;
+        }
+        int escritor, numero;
+        if (sscanf(copia.c_str() + p, "w%d-%d-", &escritor, &numero) != 2 ||
+            escritor < 0 || escritor >= numEscritores ||
+            copia.compare(p, nl - p + 1, lineaEscritor(escritor, numero)) != 0 ||
+            numero <= ultimo[escritor]) {
+            return false;
+        }
+        ultimo[escritor] = numero;
+        p = nl + 1;
+    }
+    return true;
+}
+
+static void probarConcurrencia(int escrituras) {
+    const int numEscritores = 4;
+    const int numLectores = 2;
+    HistorialSala historial(1024);
+    atomic<bool> terminado(false);
+    atomic<long> copiasMalas(0), retrocesos(0), copias(0);
+
+    vector<thread> lectores;
+    for (int l = 0; l < numLectores; ++l) {
+        lectores.emplace_back([&]() {
+            string copia;
+            uint64_t anterior = 0;
+            while (!terminado.load()) {
+                copia.clear();
+                uint64_t hasta = historial.copiar(copia);
+                if (!copiaCorrecta(copia, numEscritores)) {
+                    copiasMalas++;
+                }
+                if (hasta < anterior) {
+                    retrocesos++;
+                }
+                anterior = hasta;
+                copias++;
+            }
+        });
+    }
+
+    vector<thread> escritores;
+    for (int e = 0; e < numEscritores; ++e) {
+        escritores.emplace_back([&historial, e, escrituras]() {
+            for (int i = 0; i < escrituras; ++i) {
+                string linea = lineaEscritor(e, i);
+                historial.agregar(linea.data(), linea.size());
+            }
+        });
+    }
+    for (thread& escritor : escritores) {
+        escritor.join();
+    }
+    terminado = true;
+    for (thread& lector : lectores) {
+        lector.join();
+    }
+
+    string ultima = lineaEscritor(0, escrituras);
+    uint64_t posicion = historial.agregar(ultima.data(), ultima.size());
+    string final;
+    uint64_t hasta = historial.copiar(final);
+    comprobar(copiaCorrecta(final, numEscritores), "copia final bien formada");
+    comprobar(final.size() >= ultima.size() &&
+              final.compare(final.size() - ultima.size(), ultima.size(), ultima) == 0,
+              "el último mensaje guardado cierra la copia");
+    comprobar(posicion < hasta, "el último mensaje queda antes de la posición de copiar");
+    // Con líneas cortas, aun con sus cabeceras, ocupan más de medio anillo
+    comprobar(final.size() > 1024 / 2, "la copia aprovecha el presupuesto");
+    comprobar(copiasMalas == 0, to_string(copiasMalas.load()) + " copias con líneas rotas o desordenadas");
+    comprobar(retrocesos == 0, to_string(retrocesos.load()) + " veces retrocedió la posición de copiar");
+    cout << "concurrencia: " << copias.load() << " copias de " << numLectores << " lectores, "
+         << numEscritores << " escritores x " << escrituras << " mensajes" << endl;
+}
+
+int main(int argc, char** argv) {
+    int escrituras = argc > 1 ? atoi(argv[1]) : 20000;
+    if (escrituras <= 0) {
+        cerr << "Uso: ./historial_test [escrituras por hilo]" << endl;
+        return 1;
+    }
+
+    probarBasico();
+    probarConcurrencia(escrituras);
+
+    if (fallos > 0) {
+        cerr << fallos << " fallos" << endl;
+        return 1;
+    }
+    cout << "historial: todo correcto" << endl;
+    return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * indice.h - Índice de ID de cliente a valor con búsqueda sin cerrojos
+ *
+ * Tabla hash de direccionamiento abierto y capacidad fija. Cada entrada es
+ * un único atómico de 64 bits (ID en la mitad alta, valor en la baja), así
+ * que un lector nunca ve una entrada a medias y busca sin cerrojos mientras
+ * otro hilo inserta o borra. Las altas y bajas se serializan con un mutex.
+ *
+ * Un borrado deja una marca que la búsqueda salta. La siguiente alta que pase
+ * por ella la reutiliza, y si el hueco que la sigue está libre se limpia en el
+ * momento (con las marcas anteriores), porque ninguna clave puede estar
+ * detrás: así las cadenas de sondeo no crecen con las conexiones que entran y
+ * salen. Los IDs deben ser mayores que 0.
+ */
+
+#ifndef _INDICE_H_
+#define _INDICE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+class IndiceIds {
+
+public:
+    // La capacidad real es la potencia de 2 que deja la ocupación en 1/2 o menos
+    explicit IndiceIds(size_t maxElementos) : capacidad(2), numElementos(0) {
+        while (capacidad < 2 * maxElementos) {
+            capacidad <<= 1;
+        }
+        entradas = new std::atomic<uint64_t>[capacidad];
+        for (size_t i = 0; i < capacidad; ++i) {
+            entradas[i].store(VACIA, std::memory_order_relaxed);
+        }
+    }
+
+    ~IndiceIds() {
+        delete[] entradas;
+    }
+
+    IndiceIds(const IndiceIds&) = delete;
+    IndiceIds& operator=(const IndiceIds&) = delete;
+
+    // false si la tabla está llena (con maxElementos respetado no pasa)
+    bool insertar(int id, uint32_t valor) {
+        std::lock_guard<std::mutex> lock(escrituraMutex);
+        if (numElementos + 1 >= capacidad) {
+            return false;
+        }
+        size_t i = posicionInicial(id);
+        while (true) {
+            uint64_t entrada = entradas[i].load(std::memory_order_relaxed);
+            if (entrada == VACIA || entrada == BORRADA) {
+                entradas[i].store(codificar(id, valor), std::memory_order_release);
+                ++numElementos;
+                return true;
+            }
+            i = (i + 1) & (capacidad - 1);
+        }
+    }
+
+    bool eliminar(int id) {
+        std::lock_guard<std::mutex> lock(escrituraMutex);
+        size_t i;
+        if (!localizar(id, i)) {
+            return false;
+        }
+        entradas[i].store(BORRADA, std::memory_order_release);
+        --numElementos;
+
+        // Sin nada detrás, las marcas del final del grupo vuelven a estar libres
+        size_t mascara = capacidad - 1;
+        if (entradas[(i + 1) & mascara].load(std::memory_order_relaxed) == VACIA) {
+            while (entradas[i].load(std::memory_order_relaxed) == BORRADA) {
+                entradas[i].store(VACIA, std::memory_order_release);
+                i = (i - 1) & mascara;
+            }
+        }
+        return true;
+    }
+
+    // Sin cerrojos. false si el ID no está
+    bool buscar(int id, uint32_t& valor) const {
+        size_t i;
+        return localizar(id, i, &valor);
+    }
+
+private:
+    static const uint64_t VACIA = 0;
+    static const uint64_t BORRADA = 1;    // ID 0: nunca es una clave válida
+
+    static uint64_t codificar(int id, uint32_t valor) {
+        return (uint64_t)(uint32_t)id << 32 | valor;
+    }
+
+    size_t posicionInicial(int id) const {
+        return ((uint32_t)id * 2654435761u) & (capacidad - 1);
+    }
+
+    bool localizar(int id, size_t& posicion, uint32_t* valor = nullptr) const {
+        size_t i = posicionInicial(id);
+        for (size_t sondeos = 0; sondeos < capacidad; ++sondeos) {
+            uint64_t entrada = entradas[i].load(std::memory_order_acquire);
+            if (entrada == VACIA) {
+                return false;
+            }
+            if ((entrada >> 32) == (uint32_t)id) {
+                posicion = i;
+                if (valor != nullptr) {
+                    *valor = (uint32_t)entrada;
+                }
+                return true;
+            }
+            i = (i + 1) & (capacidad - 1);
+        }
+        return false;
+    }
+
+    std::atomic<uint64_t>* entradas;
+    size_t capacidad;
+    size_t numElementos;
+    std::mutex escrituraMutex;
+};
+
+#endif
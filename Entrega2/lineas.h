@@ -0,0 +1,170 @@
+/*
+ * lineas.h - Separación incremental en líneas del protocolo de texto
+ *
+ * Cada conexión tiene un LectorLineas con su buffer de recepción. Los datos
+ * pueden llegar de dos formas:
+ * - hueco + confirmar: recv escribe directamente en el buffer del lector
+ * - consumir: los datos ya están en otro buffer (los de io_uring) y se
+ *   separan allí mismo; solo se copia al lector la línea incompleta del final
+ *
+ * Cada lectura entrega todas las líneas completas que contenga de una vez y
+ * conserva el trozo final sin '\n' para la siguiente. Los bytes de una línea
+ * no se vuelven a copiar salvo que se quede a medias y haga falta hueco.
+ */
+
+#ifndef _LINEAS_H_
+#define _LINEAS_H_
+
+#include <cstring>
+#include <memory>
+
+class LectorLineas {
+
+public:
+    // Líneas más largas se entregan troceadas para acotar la memoria
+    static const size_t MAX_LINEA = 64 * 1024;
+
+    LectorLineas() : capacidad(0), inicio(0), fin(0), escaneado(0) {}
+
+    // Devuelve dónde puede escribir recv y cuánto (al menos minimo bytes).
+    // El buffer se reserva la primera vez que se usa
+    char* hueco(size_t minimo, size_t& disponible) {
+        if (inicio == fin) {
+            // Todo entregado: se vuelve al principio sin copiar nada y se
+            // suelta el buffer que hubiera crecido por una línea larga
+            inicio = fin = escaneado = 0;
+            if (capacidad > CAPACIDAD_INICIAL) {
+                buffer.reset();
+                capacidad = 0;
+            }
+        }
+        if (capacidad - fin < minimo) {
+            hacerHueco(minimo);
+        }
+        disponible = capacidad - fin;
+        return buffer.get() + fin;
+    }
+
+    // Marca como recibidos n bytes escritos en el hueco y llama a
+    // f(const char* linea, size_t longitud) por cada línea completa (sin
+    // "\r\n"). Si f devuelve false se deja de entregar y se descarta el resto
+    template<typename F>
+    bool confirmar(size_t n, F f) {
+        fin += n;
+        return entregar(f);
+    }
+
+    // Procesa datos que están en un buffer ajeno. Las líneas completas se
+    // entregan desde ese buffer; solo la línea pendiente pasa por el lector
+    template<typename F>
+    bool consumir(const char* datos, size_t n, F f) {
+        if (inicio != fin) {
+            // Completar la línea que quedó a medias
+            const char* nl = static_cast<const char*>(memchr(datos, '\n', n));
+            size_t parte = nl ? nl - datos + 1 : n;
+            size_t disponible;
+            memcpy(hueco(parte, disponible), datos, parte);
+            if (!confirmar(parte, f)) {
+                return false;
+            }
+            datos += parte;
+            n -= parte;
+        }
+
+        while (n > 0) {
+            const char* nl = static_cast<const char*>(memchr(datos, '\n', n));
+            if (nl == nullptr) {
+                break;
+            }
+            size_t longitud = nl - datos;
+            if (!entregarLinea(datos, longitud, f)) {
+                inicio = fin = escaneado = 0;
+                return false;
+            }
+            datos = nl + 1;
+            n -= longitud + 1;
+        }
+
+        if (n > 0) {
+            size_t disponible;
+            memcpy(hueco(n, disponible), datos, n);
+            return confirmar(n, f);
+        }
+        return true;
+    }
+
+private:
+    std::unique_ptr<char[]> buffer;
+    size_t capacidad;
+    size_t inicio;      // Primer byte aún no entregado
+    size_t fin;         // Final de los datos recibidos
+    size_t escaneado;   // Hasta aquí ya se buscó '\n' sin encontrarlo
+
+    static const size_t CAPACIDAD_INICIAL = 4096;
+
+    template<typename F>
+    static bool entregarLinea(const char* linea, size_t longitud, F& f) {
+        if (longitud > 0 && linea[longitud - 1] == '\r') {
+            longitud--;
+        }
+        if (longitud == 0) {
+            return true;  // Líneas vacías: el cliente tampoco las envía
+        }
+        return f(linea, longitud);
+    }
+
+    template<typename F>
+    bool entregar(F& f) {
+        char* base = buffer.get();
+        while (true) {
+            char* nl = static_cast<char*>(memchr(base + escaneado, '\n', fin - escaneado));
+            if (nl == nullptr) {
+                break;
+            }
+            size_t longitud = nl - (base + inicio);
+            if (!entregarLinea(base + inicio, longitud, f)) {
+                inicio = fin = escaneado = 0;
+                return false;
+            }
+            inicio = escaneado = nl - base + 1;
+        }
+        escaneado = fin;
+
+        if (fin - inicio >= MAX_LINEA) {
+            // Línea demasiado larga: se entrega lo que hay como una línea
+            bool seguir = entregarLinea(base + inicio, fin - inicio, f);
+            inicio = fin = escaneado = 0;
+            return seguir;
+        }
+        return true;
+    }
+
+    // Deja al menos minimo bytes libres tras fin. Solo mueve la línea
+    // incompleta, y solo cuando no queda sitio detrás de ella
+    void hacerHueco(size_t minimo) {
+        size_t pendiente = fin - inicio;
+        size_t necesaria = pendiente + minimo;
+        if (necesaria <= capacidad) {
+            memmove(buffer.get(), buffer.get() + inicio, pendiente);
+        } else {
+            size_t nueva = CAPACIDAD_INICIAL;
+            if (capacidad > nueva) {
+                nueva = capacidad;
+            }
+            while (nueva < necesaria) {
+                nueva *= 2;
+            }
+            std::unique_ptr<char[]> otro(new char[nueva]);
+            if (pendiente > 0) {
+                memcpy(otro.get(), buffer.get() + inicio, pendiente);
+            }
+            buffer.swap(otro);
+            capacidad = nueva;
+        }
+        escaneado -= inicio;
+        fin = pendiente;
+        inicio = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,347 @@
+/*
+ * log.cpp - Implementación del registro de eventos asíncrono
+ *
+ * Cada hilo crea su anillo la primera vez que registra algo (un hilo que no
+ * registra nada no gasta memoria) y lo entrega al hilo de fondo por un buzón
+ * sin cerrojos. Los hilos de cada cliente piden uno pequeño con
+ * tamanoAnilloLog: con miles de clientes, 128 KiB por hilo serían cientos
+ * de MB. Cuando el hilo termina (modo hilos) el anillo se marca como
+ * abandonado y el hilo de fondo lo libera tras vaciarlo.
+ *
+ * Formato binario: "CHATLOG1" y después, por cada entrada, la cabecera de
+ * EntradaLog (24 bytes, orden de bytes de la máquina) seguida del texto.
+ */
+
+#include "log.h"
+#include "buzon.h"
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const size_t TAM_TEXTO_LOG = 104;      // Entradas de 128 bytes
+static const unsigned CAPACIDAD_ANILLO = 1024; // Entradas por hilo por defecto (potencia de 2)
+static const char CABECERA_BINARIO[8] = { 'C', 'H', 'A', 'T', 'L', 'O', 'G', '1' };
+
+struct EntradaLog {
+    uint64_t marcaTiempo;   // Nanosegundos desde 1970
+    uint8_t nivel;
+    uint8_t evento;
+    uint16_t longitud;      // Bytes usados de texto
+    int32_t id;
+    int64_t valor;
+    char texto[TAM_TEXTO_LOG];
+};
+
+static const size_t TAM_CABECERA_ENTRADA = offsetof(EntradaLog, texto);
+
+// Anillo de un hilo. escritura solo la mueve el hilo dueño y lectura solo el
+// hilo de fondo; cada índice va en su propia línea de caché
+struct AnilloLog {
+    atomic<unsigned> escritura;
+    char relleno1[64 - sizeof(atomic<unsigned>)];
+    atomic<unsigned> lectura;
+    char relleno2[64 - sizeof(atomic<unsigned>)];
+    atomic<unsigned long> descartados;
+    atomic<bool> abandonado;
+    const unsigned capacidad;               // Potencia de 2
+    unique_ptr<EntradaLog[]> entradas;
+
+    explicit AnilloLog(unsigned capacidad)
+        : escritura(0), lectura(0), descartados(0), abandonado(false),
+          capacidad(capacidad), entradas(new EntradaLog[capacidad]) {}
+};
+
+// Marca el anillo del hilo como abandonado cuando el hilo termina
+struct DuenoAnillo {
+    AnilloLog* anillo;
+    DuenoAnillo() : anillo(nullptr) {}
+    ~DuenoAnillo() {
+        if (anillo != nullptr) {
+            anillo->abandonado.store(true, memory_order_release);
+        }
+    }
+};
+
+atomic<int> nivelLogMinimo(LOG_INFO);
+
+static thread_local DuenoAnillo duenoAnillo;
+static thread_local unsigned capacidadAnilloHilo = CAPACIDAD_ANILLO;
+static BuzonMPSC<AnilloLog*> anillosNuevos;       // Anillos aún no vistos por el hilo de fondo
+static atomic<unsigned long> totalDescartados(0);
+static atomic<bool> detener(false);
+static thread* hiloLog = nullptr;
+static int fdLog = STDOUT_FILENO;
+static bool logBinario = false;
+
+static const char* textoNivel(int nivel) {
+    switch (nivel) {
+        case LOG_DEBUG: return "DEBUG";
+        case LOG_INFO: return "INFO ";
+        case LOG_AVISO: return "AVISO";
+        default: return "ERROR";
+    }
+}
+
+bool nivelDesdeTexto(const string& texto, NivelLog& nivel) {
+    if (texto == "debug") {
+        nivel = LOG_DEBUG;
+    } else if (texto == "info") {
+        nivel = LOG_INFO;
+    } else if (texto == "aviso") {
+        nivel = LOG_AVISO;
+    } else if (texto == "error") {
+        nivel = LOG_ERROR;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void tamanoAnilloLog(unsigned entradas) {
+    unsigned capacidad = 1;
+    while (capacidad < entradas && capacidad < CAPACIDAD_ANILLO) {
+        capacidad *= 2;
+    }
+    capacidadAnilloHilo = capacidad;
+}
+
+unsigned long logDescartados() {
+    return totalDescartados.load(memory_order_relaxed);
+}
+
+void registrarLog(NivelLog nivel, EventoLog evento, int id, long long valor,
+                  const char* texto, size_t longitud) {
+    AnilloLog* anillo = duenoAnillo.anillo;
+    if (anillo == nullptr) {
+        anillo = new AnilloLog(capacidadAnilloHilo);
+        duenoAnillo.anillo = anillo;
+        anillosNuevos.depositar(anillo);
+    }
+
+    unsigned escritura = anillo->escritura.load(memory_order_relaxed);
+    if (escritura - anillo->lectura.load(memory_order_acquire) >= anillo->capacidad) {
+        anillo->descartados.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    struct timespec ahora;
+    clock_gettime(CLOCK_REALTIME, &ahora);
+
+    EntradaLog& entrada = anillo->entradas[escritura & (anillo->capacidad - 1)];
+    entrada.marcaTiempo = static_cast<uint64_t>(ahora.tv_sec) * 1000000000ULL + ahora.tv_nsec;
+    entrada.nivel = nivel;
+    entrada.evento = evento;
+    entrada.id = id;
+    entrada.valor = valor;
+    entrada.longitud = longitud < TAM_TEXTO_LOG ? longitud : TAM_TEXTO_LOG;
+    if (entrada.longitud > 0) {
+        memcpy(entrada.texto, texto, entrada.longitud);
+    }
+
+    anillo->escritura.store(escritura + 1, memory_order_release);
+}
+
+// Añade a salida la entrada en texto, terminada en '\n'
+static void formatearEntrada(const EntradaLog& entrada, string& salida) {
+    time_t segundos = entrada.marcaTiempo / 1000000000ULL;
+    unsigned micros = (entrada.marcaTiempo % 1000000000ULL) / 1000;
+    struct tm fecha;
+    localtime_r(&segundos, &fecha);
+    char prefijo[64];
+    snprintf(prefijo, sizeof(prefijo), "%02d:%02d:%02d.%06u %s ",
+             fecha.tm_hour, fecha.tm_min, fecha.tm_sec, micros, textoNivel(entrada.nivel));
+    salida += prefijo;
+
+    string id = to_string(entrada.id);
+    switch (entrada.evento) {
+        case EVENTO_CONEXION:
+            salida += "[SERVIDOR] Cliente " + id + " conectado (socket: " +
+                      to_string(entrada.valor) + ")";
+            break;
+        case EVENTO_DESCONEXION:
+            salida += "[SERVIDOR] Cliente " + id + " desconectado";
+            break;
+        case EVENTO_MENSAJE:
+            salida += "cliente " + id + ": ";
+            salida.append(entrada.texto, entrada.longitud);
+            if (entrada.valor > entrada.longitud) {
+                salida += "... (" + to_string(entrada.valor) + " bytes)";
+            }
+            break;
+        case EVENTO_RECHAZO:
+            salida += "[SERVIDOR] Límite de " + to_string(entrada.valor) +
+                      " clientes alcanzado, se rechaza al cliente " + id;
+            break;
+        case EVENTO_DESCARTES:
+            salida += "[LOG] " + to_string(entrada.valor) +
+                      " entradas descartadas por anillos llenos";
+            break;
+        default:
+            salida.append(entrada.texto, entrada.longitud);
+            break;
+    }
+    salida += '\n';
+}
+
+static void anadirEntrada(const EntradaLog& entrada, string& lote) {
+    if (logBinario) {
+        lote.append(reinterpret_cast<const char*>(&entrada), TAM_CABECERA_ENTRADA);
+        lote.append(entrada.texto, entrada.longitud);
+    } else {
+        formatearEntrada(entrada, lote);
+    }
+}
+
+static void escribirTodo(int fd, const string& datos) {
+    size_t escrito = 0;
+    while (escrito < datos.size()) {
+        ssize_t n = write(fd, datos.data() + escrito, datos.size() - escrito);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;  // Sin sitio donde avisar: se pierde el lote
+        }
+        escrito += n;
+    }
+}
+
+// Recoge lo que haya en un anillo. Devuelve cuántas entradas había
+static unsigned vaciarAnillo(AnilloLog& anillo, string& lote) {
+    unsigned lectura = anillo.lectura.load(memory_order_relaxed);
+    unsigned escritura = anillo.escritura.load(memory_order_acquire);
+    for (unsigned i = lectura; i != escritura; ++i) {
+        anadirEntrada(anillo.entradas[i & (anillo.capacidad - 1)], lote);
+    }
+    anillo.lectura.store(escritura, memory_order_release);
+    return escritura - lectura;
+}
+
+// Hilo de fondo: vacía todos los anillos y escribe un lote por vuelta.
+// Si no hay nada espera cada vez más (hasta 10 ms) para no ocupar la CPU
+static void bucleLog() {
+    vector<AnilloLog*> anillos;
+    string lote;
+    unsigned long descartadosLiberados = 0;  // De anillos ya borrados
+    unsigned long descartadosAvisados = 0;
+    int esperaMicros = 100;
+
+    while (true) {
+        anillosNuevos.recogerTodo(anillos);
+
+        unsigned recogidas = 0;
+        unsigned long descartados = descartadosLiberados;
+        for (size_t i = 0; i < anillos.size();) {
+            AnilloLog* anillo = anillos[i];
+            // Se mira antes de vaciar: si ya estaba abandonado no llegará nada más
+            bool abandonado = anillo->abandonado.load(memory_order_acquire);
+            recogidas += vaciarAnillo(*anillo, lote);
+            descartados += anillo->descartados.load(memory_order_relaxed);
+            if (abandonado) {
+                descartadosLiberados += anillo->descartados.load(memory_order_relaxed);
+                delete anillo;
+                anillos[i] = anillos.back();
+                anillos.pop_back();
+            } else {
+                ++i;
+            }
+        }
+
+        totalDescartados.store(descartados, memory_order_relaxed);
+        if (descartados > descartadosAvisados) {
+            EntradaLog aviso;
+            memset(&aviso, 0, TAM_CABECERA_ENTRADA);
+            struct timespec ahora;
+            clock_gettime(CLOCK_REALTIME, &ahora);
+            aviso.marcaTiempo = static_cast<uint64_t>(ahora.tv_sec) * 1000000000ULL + ahora.tv_nsec;
+            aviso.nivel = LOG_AVISO;
+            aviso.evento = EVENTO_DESCARTES;
+            aviso.valor = descartados;
+            anadirEntrada(aviso, lote);
+            descartadosAvisados = descartados;
+        }
+
+        if (!lote.empty()) {
+            escribirTodo(fdLog, lote);
+            lote.clear();
+        }
+
+        if (recogidas > 0) {
+            esperaMicros = 100;
+            continue;
+        }
+        if (detener.load()) {
+            break;
+        }
+        this_thread::sleep_for(chrono::microseconds(esperaMicros));
+        esperaMicros = esperaMicros < 10000 ? esperaMicros * 2 : 10000;
+    }
+}
+
+bool iniciarLog(NivelLog nivel, const string& archivo, bool binario) {
+    nivelLogMinimo.store(nivel);
+    logBinario = binario;
+
+    if (!archivo.empty()) {
+        fdLog = open(archivo.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fdLog < 0) {
+            fdLog = STDOUT_FILENO;
+            return false;
+        }
+        if (binario) {
+            escribirTodo(fdLog, string(CABECERA_BINARIO, sizeof(CABECERA_BINARIO)));
+        }
+    }
+
+    detener.store(false);
+    hiloLog = new thread(bucleLog);
+    return true;
+}
+
+void detenerLog() {
+    if (hiloLog == nullptr) {
+        return;
+    }
+    detener.store(true);
+    hiloLog->join();
+    delete hiloLog;
+    hiloLog = nullptr;
+    if (fdLog != STDOUT_FILENO) {
+        close(fdLog);
+        fdLog = STDOUT_FILENO;
+    }
+}
+
+bool formatearLogBinario(const string& archivo, ostream& salida) {
+    ifstream entrada(archivo.c_str(), ios::binary);
+    char cabecera[sizeof(CABECERA_BINARIO)];
+    if (!entrada.read(cabecera, sizeof(cabecera)) ||
+        memcmp(cabecera, CABECERA_BINARIO, sizeof(cabecera)) != 0) {
+        return false;
+    }
+
+    EntradaLog registro;
+    string texto;
+    while (entrada.read(reinterpret_cast<char*>(&registro), TAM_CABECERA_ENTRADA)) {
+        if (registro.longitud > TAM_TEXTO_LOG ||
+            !entrada.read(registro.texto, registro.longitud)) {
+            return false;  // Archivo truncado o corrupto
+        }
+        formatearEntrada(registro, texto);
+        salida << texto;
+        texto.clear();
+    }
+    return true;
+}
@@ -0,0 +1,83 @@
+/*
+ * log.h - Registro de eventos asíncrono del servidor
+ *
+ * Los hilos que atienden clientes no escriben en consola: cada hilo deja sus
+ * entradas en un anillo propio (un productor y un consumidor, sin cerrojos) y
+ * un hilo de fondo las recoge, les da formato y las escribe por lotes en la
+ * salida estándar o en un archivo. Si un anillo está lleno la entrada se
+ * descarta y se cuenta.
+ *
+ * En modo binario el hilo de fondo no da formato: guarda las entradas tal cual
+ * y se convierten a texto después con formatearLogBinario (--ver-log).
+ */
+
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <atomic>
+#include <iosfwd>
+#include <string>
+#include <cstddef>
+
+enum NivelLog {
+    LOG_DEBUG = 0,
+    LOG_INFO = 1,
+    LOG_AVISO = 2,
+    LOG_ERROR = 3
+};
+
+// Tipo de entrada: el texto final se compone al dar formato, no al registrar
+enum EventoLog {
+    EVENTO_TEXTO = 0,        // Texto libre
+    EVENTO_CONEXION = 1,     // id = cliente, valor = socket
+    EVENTO_DESCONEXION = 2,  // id = cliente
+    EVENTO_MENSAJE = 3,      // id = cliente, valor = longitud original, texto = mensaje
+    EVENTO_RECHAZO = 4,      // id = cliente, valor = límite de clientes
+    EVENTO_DESCARTES = 5     // valor = entradas descartadas hasta ahora
+};
+
+extern std::atomic<int> nivelLogMinimo;
+
+// Arranca el hilo de fondo. Con archivo vacío se escribe en la salida
+// estándar; binario solo tiene sentido con archivo. Devuelve false si no se
+// pudo abrir el archivo
+bool iniciarLog(NivelLog nivel, const std::string& archivo, bool binario);
+
+// Escribe lo pendiente y para el hilo de fondo
+void detenerLog();
+
+bool nivelDesdeTexto(const std::string& texto, NivelLog& nivel);
+
+// Entradas del anillo del hilo actual en vez de las 1024 por defecto (se
+// redondea a potencia de 2, sin pasar de 1024). Solo tiene efecto antes de
+// que el hilo registre nada: el anillo se crea con su primera entrada
+void tamanoAnilloLog(unsigned entradas);
+
+// Entradas perdidas porque el anillo de su hilo estaba lleno
+unsigned long logDescartados();
+
+// Convierte un archivo de log binario a texto. Devuelve false si no es válido
+bool formatearLogBinario(const std::string& archivo, std::ostream& salida);
+
+// Copia la entrada al anillo del hilo actual (texto se trunca si no cabe)
+void registrarLog(NivelLog nivel, EventoLog evento, int id, long long valor,
+                  const char* texto, size_t longitud);
+
+inline bool logActivo(NivelLog nivel) {
+    return nivel >= nivelLogMinimo.load(std::memory_order_relaxed);
+}
+
+inline void logEvento(NivelLog nivel, EventoLog evento, int id, long long valor = 0,
+                      const char* texto = nullptr, size_t longitud = 0) {
+    if (logActivo(nivel)) {
+        registrarLog(nivel, evento, id, valor, texto, longitud);
+    }
+}
+
+inline void logTexto(NivelLog nivel, const std::string& texto) {
+    if (logActivo(nivel)) {
+        registrarLog(nivel, EVENTO_TEXTO, 0, 0, texto.data(), texto.size());
+    }
+}
+
+#endif
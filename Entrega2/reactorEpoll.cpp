@@ -0,0 +1,345 @@
+/*
+ * reactorEpoll.cpp - Implementación del reactor epoll
+ *
+ * Cada reactor tiene su propio epoll y su propio socket de escucha: todos se
+ * abren con SO_REUSEPORT sobre el mismo puerto y el kernel reparte las
+ * conexiones entrantes entre ellos, así que no comparten cola de accept.
+ * Los clientes se registran con EPOLLIN | EPOLLOUT | EPOLLET: se lee hasta
+ * EAGAIN y, si un envío se quedó a medias, EPOLLOUT avisa cuando el socket
+ * vuelve a tener hueco.
+ *
+ * Un broadcast se reparte por shards: el reactor emisor lo entrega
+ * directamente a sus clientes y deja el mensaje en el buzón de cada uno de
+ * los demás, que lo entregan a los suyos en su propio hilo. Solo el reactor
+ * dueño escribe en el socket de un cliente; si otro hilo le encola algo deja
+ * su ID en el buzón de envíos. Los buzones no usan cerrojos y un eventfd
+ * despierta al reactor cuando su buzón pasa de vacío a no vacío.
+ */
+
+#include "reactorEpoll.h"
+#include "log.h"
+
+#include <memory>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const int MAX_EVENTOS = 64;
+static const int MAX_ACCEPT_POR_EVENTO = 16;  // No acaparar el reactor con accepts
+static const size_t MIN_LECTURA = 1024;       // Hueco mínimo para cada recv
+
+// Reactor que se ejecuta en el hilo actual (nullptr fuera de los reactores)
+static thread_local ReactorEpoll* reactorActual = nullptr;
+
+static void ponerNoBloqueante(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Reparte los broadcasts entre los reactores, uno por shard
+class RepartoEpoll : public RepartoShards {
+public:
+    std::vector<ReactorEpoll*> reactores;
+
+    void difundir(int shard, const MensajePtr& mensaje, int idEmisor, int sala,
+                  uint64_t posicion) override {
+        reactores[shard]->recibirDifusion(mensaje, idEmisor, sala, posicion);
+    }
+};
+
+// Abre otro socket de escucha en la misma dirección que serverSocket.
+// Devuelve -1 si falla
+static int abrirEscuchaAdicional(int serverSocket) {
+    struct sockaddr_in direccion;
+    socklen_t longitud = sizeof(direccion);
+    if (getsockname(serverSocket, (struct sockaddr*)&direccion, &longitud) < 0) {
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int opcion = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opcion, sizeof(opcion)) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opcion, sizeof(opcion)) < 0 ||
+        bind(fd, (struct sockaddr*)&direccion, longitud) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+ReactorEpoll::ReactorEpoll(int serverSocket, int shard)
+    : serverSocket(serverSocket), shard(shard), eventFd(-1) {
+    epollFd = epoll_create1(0);
+    if (epollFd < 0) {
+        logTexto(LOG_ERROR, string("[ERROR] Fallo al crear epoll: ") + strerror(errno));
+        return;
+    }
+
+    // El socket de escucha se marca con ptr == nullptr. EPOLLEXCLUSIVE solo
+    // importa si no se pudo abrir uno propio y se comparte con otro reactor
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.ptr = nullptr;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, serverSocket, &ev) < 0) {
+        logTexto(LOG_ERROR, string("[ERROR] Fallo al registrar el socket de escucha: ") + strerror(errno));
+    }
+
+    // El eventfd se marca con ptr == this
+    eventFd = eventfd(0, EFD_NONBLOCK);
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = this;
+    if (eventFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, eventFd, &ev) < 0) {
+        logTexto(LOG_ERROR, string("[ERROR] Fallo al crear el eventfd del reactor: ") + strerror(errno));
+    }
+}
+
+ReactorEpoll::~ReactorEpoll() {
+    if (eventFd >= 0) {
+        close(eventFd);
+    }
+    if (epollFd >= 0) {
+        close(epollFd);
+    }
+}
+
+void ReactorEpoll::ejecutar() {
+    struct epoll_event eventos[MAX_EVENTOS];
+    reactorActual = this;
+
+    while (true) {
+        int n = epoll_wait(epollFd, eventos, MAX_EVENTOS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            logTexto(LOG_ERROR, string("[ERROR] epoll_wait: ") + strerror(errno));
+            return;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            if (eventos[i].data.ptr == nullptr) {
+                aceptarClientes();
+                continue;
+            }
+            if (eventos[i].data.ptr == this) {
+                uint64_t valor;
+                while (read(eventFd, &valor, sizeof(valor)) > 0) {}
+                continue;  // Los buzones se atienden tras el lote
+            }
+
+            Conexion& conexion = *static_cast<Conexion*>(eventos[i].data.ptr);
+            if (conexion.cerrada) {
+                continue;  // Cerrada antes en este mismo lote
+            }
+
+            bool seguir = !(eventos[i].events & (EPOLLERR | EPOLLHUP));
+            if (seguir && (eventos[i].events & EPOLLOUT)) {
+                seguir = vaciarPendiente(conexion);
+            }
+            if (seguir && (eventos[i].events & EPOLLIN)) {
+                seguir = leerCliente(conexion);
+            }
+            if (!seguir) {
+                cerrarCliente(conexion);
+            }
+        }
+
+        // Broadcasts de otros reactores y mensajes encolados durante el lote
+        escribirPendientes();
+
+        // Ningún evento de este lote apunta ya a las conexiones cerradas
+        cerradas.clear();
+    }
+}
+
+void ReactorEpoll::aceptarClientes() {
+    for (int i = 0; i < MAX_ACCEPT_POR_EVENTO; ++i) {
+        struct sockaddr_in clientAddr;
+        socklen_t clientAddrLen = sizeof(clientAddr);
+
+        int clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientAddrLen);
+        if (clientSocket < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                logTexto(LOG_ERROR, string("[ERROR] Fallo al aceptar conexión: ") + strerror(errno));
+            }
+            return;
+        }
+
+        ponerNoBloqueante(clientSocket);
+
+        ConexionPtr conexion = make_shared<Conexion>(clientSocket, nuevoIdCliente(), this, shard);
+        conexiones[conexion->id] = conexion;
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.ptr = conexion.get();
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &ev) < 0) {
+            logTexto(LOG_ERROR, "[ERROR] Fallo al registrar cliente en epoll");
+            conexiones.erase(conexion->id);
+            close(clientSocket);
+            continue;
+        }
+
+        if (!conectarCliente(conexion)) {
+            cerrarCliente(*conexion);
+        }
+    }
+}
+
+// Lee hasta vaciar el socket (edge-triggered): hasta EAGAIN o 0, aunque una
+// lectura salga corta, porque el FIN puede haber llegado con los últimos datos
+// y no habría otro evento para verlo. Devuelve false si hay que cerrar.
+// Cada recv escribe en el buffer de líneas de la conexión y se procesan
+// todas las líneas completas que traiga
+bool ReactorEpoll::leerCliente(Conexion& conexion) {
+    while (true) {
+        size_t disponible;
+        char* hueco = conexion.entrada.hueco(MIN_LECTURA, disponible);
+        int bytesRecibidos = recv(conexion.socket, hueco, disponible, 0);
+
+        if (bytesRecibidos < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;  // Socket vacío
+        }
+        if (bytesRecibidos <= 0) {
+            // Cliente desconectado o error
+            logEvento(LOG_INFO, EVENTO_DESCONEXION, conexion.id);
+            return false;
+        }
+
+        bool seguir = conexion.entrada.confirmar(bytesRecibidos,
+            [&conexion](const char* linea, size_t longitud) {
+                return procesarMensaje(conexion, linea, longitud);
+            });
+        if (!seguir) {
+            // "exit": intentar enviar ya la respuesta antes de cerrar
+            vaciarPendiente(conexion);
+            return false;
+        }
+    }
+}
+
+void ReactorEpoll::programarEnvio(Conexion& conexion) {
+    if (reactorActual == this) {
+        pendientesLocales.push_back(conexion.id);
+        return;
+    }
+
+    if (buzonEnvios.depositar(conexion.id)) {
+        despertar();
+    }
+}
+
+void ReactorEpoll::recibirDifusion(const MensajePtr& mensaje, int idEmisor, int sala,
+                                   uint64_t posicion) {
+    if (reactorActual == this) {
+        broadcastShard(shard, mensaje, idEmisor, sala, posicion);
+        return;
+    }
+
+    Difusion difusion;
+    difusion.mensaje = mensaje;
+    difusion.idEmisor = idEmisor;
+    difusion.sala = sala;
+    difusion.posicion = posicion;
+    if (buzonDifusiones.depositar(difusion)) {
+        despertar();
+    }
+}
+
+void ReactorEpoll::despertar() {
+    uint64_t uno = 1;
+    if (write(eventFd, &uno, sizeof(uno)) < 0) {
+        logTexto(LOG_ERROR, string("[ERROR] Fallo al despertar reactor: ") + strerror(errno));
+    }
+}
+
+// Entrega los broadcasts recibidos y escribe las colas de las conexiones que
+// tienen mensajes nuevos
+void ReactorEpoll::escribirPendientes() {
+    vector<Difusion> difusiones;
+    buzonDifusiones.recogerTodo(difusiones);
+    for (const Difusion& difusion : difusiones) {
+        broadcastShard(shard, difusion.mensaje, difusion.idEmisor, difusion.sala, difusion.posicion);
+    }
+
+    vector<int> ids;
+    ids.swap(pendientesLocales);
+    buzonEnvios.recogerTodo(ids);
+
+    for (int id : ids) {
+        auto it = conexiones.find(id);
+        if (it == conexiones.end()) {
+            continue;  // Ya cerrada
+        }
+        ConexionPtr conexion = it->second;
+        if (!vaciarPendiente(*conexion)) {
+            cerrarCliente(*conexion);
+        }
+    }
+}
+
+void ReactorEpoll::cerrarCliente(Conexion& conexion) {
+    auto it = conexiones.find(conexion.id);
+    if (it == conexiones.end()) {
+        return;
+    }
+    ConexionPtr ptr = it->second;
+    conexiones.erase(it);
+    cerradas.push_back(ptr);
+
+    // close() también lo saca del epoll
+    desconectarCliente(ptr);
+}
+
+void ejecutarServidorEpoll(int serverSocket, int numReactores) {
+    // Un socket de escucha por reactor; si no se puede abrir, ese reactor
+    // comparte el principal (por eso el accept no debe bloquear)
+    vector<int> sockets;
+    sockets.push_back(serverSocket);
+    for (int i = 1; i < numReactores; ++i) {
+        int fd = abrirEscuchaAdicional(serverSocket);
+        if (fd < 0) {
+            logTexto(LOG_ERROR, "[ERROR] No se pudo abrir el socket de escucha del reactor " +
+                                to_string(i) + ": " + strerror(errno));
+            fd = serverSocket;
+        }
+        sockets.push_back(fd);
+    }
+
+    RepartoEpoll reparto;
+    vector<unique_ptr<ReactorEpoll>> reactores;
+    for (int i = 0; i < numReactores; ++i) {
+        ponerNoBloqueante(sockets[i]);
+        reactores.push_back(unique_ptr<ReactorEpoll>(new ReactorEpoll(sockets[i], i)));
+        reparto.reactores.push_back(reactores.back().get());
+    }
+    configurarShards(numReactores, &reparto);
+
+    vector<thread> hilos;
+    for (auto& reactor : reactores) {
+        ReactorEpoll* r = reactor.get();
+        hilos.push_back(thread([r]() {
+            r->ejecutar();
+        }));
+    }
+    for (auto& hilo : hilos) {
+        hilo.join();
+    }
+
+    for (int fd : sockets) {
+        if (fd != serverSocket) {
+            close(fd);
+        }
+    }
+}
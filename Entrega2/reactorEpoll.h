@@ -0,0 +1,72 @@
+/*
+ * reactorEpoll.h - Bucle de eventos epoll para el servidor de chat
+ *
+ * Alternativa al modo de un hilo por cliente: un conjunto fijo de hilos
+ * (reactores) atiende accept, lectura y escritura de todos los clientes con
+ * sockets no bloqueantes y epoll en modo edge-triggered.
+ *
+ * Cada reactor es un shard independiente: su propio socket de escucha
+ * (SO_REUSEPORT), sus conexiones y su parte de la lista global de clientes.
+ * Lo que un reactor manda a otro pasa por buzones sin cerrojos (buzon.h).
+ */
+
+#ifndef _REACTOR_EPOLL_H_
+#define _REACTOR_EPOLL_H_
+
+#include "chat.h"
+#include "buzon.h"
+
+#include <map>
+#include <vector>
+
+class ReactorEpoll : public BackendEnvio {
+
+public:
+    // serverSocket es el socket de escucha propio del reactor; shard es su
+    // índice en la lista global de clientes
+    ReactorEpoll(int serverSocket, int shard);
+    ~ReactorEpoll();
+
+    // Bucle principal del reactor (no retorna)
+    void ejecutar();
+
+    // Puede llamarse desde cualquier hilo: el reactor escribe la cola de
+    // la conexión en su propio hilo
+    void programarEnvio(Conexion& conexion) override;
+
+    // Entrega un broadcast a los clientes de la sala en este reactor. Puede
+    // llamarse desde cualquier hilo: si no es el del reactor se deja en su buzón
+    void recibirDifusion(const MensajePtr& mensaje, int idEmisor, int sala, uint64_t posicion);
+
+private:
+    // Broadcast pendiente de entregar en este shard
+    struct Difusion {
+        MensajePtr mensaje;
+        int idEmisor;
+        int sala;
+        uint64_t posicion;                  // En el historial de la sala
+    };
+
+    int epollFd;
+    int serverSocket;
+    int shard;
+    int eventFd;                            // Despierta al reactor desde otros hilos
+    std::map<int, ConexionPtr> conexiones;  // Clientes de este reactor por ID
+    std::vector<ConexionPtr> cerradas;      // Se liberan al acabar cada lote de eventos
+
+    BuzonMPSC<int> buzonEnvios;             // IDs con mensajes encolados desde otros hilos
+    BuzonMPSC<Difusion> buzonDifusiones;    // Broadcasts de otros reactores
+    std::vector<int> pendientesLocales;     // IDs con mensajes encolados desde este hilo
+
+    void despertar();
+    void escribirPendientes();
+    void aceptarClientes();
+    bool leerCliente(Conexion& conexion);
+    void cerrarCliente(Conexion& conexion);
+};
+
+// Arranca numReactores hilos con un ReactorEpoll cada uno y espera a que terminen.
+// El primero usa serverSocket y el resto abre otro socket en la misma dirección
+void ejecutarServidorEpoll(int serverSocket, int numReactores);
+
+#endif
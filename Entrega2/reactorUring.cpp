@@ -0,0 +1,409 @@
+/*
+ * reactorUring.cpp - Implementación del backend io_uring
+ *
+ * Cada petición lleva en user_data el puntero al ClienteUring y en los dos
+ * bits bajos el tipo de operación (accept, recv o send). Un ClienteUring no
+ * se libera hasta que han terminado todas sus operaciones en curso.
+ */
+
+#include "reactorUring.h"
+#include "log.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const unsigned ENTRADAS_ANILLO = 4096;
+static const unsigned NUM_BUFFERS = 1024;     // Potencia de 2
+static const unsigned TAM_BUFFER = 1024;      // Igual que el hueco mínimo de recv de los otros modos
+static const unsigned short GRUPO_BUFFERS = 0;
+
+// Tipo de operación en los bits bajos de user_data
+static const unsigned long long OP_ACCEPT = 0;
+static const unsigned long long OP_RECV = 1;
+static const unsigned long long OP_SEND = 2;
+static const unsigned long long OP_BUFFERS = 3;
+static const unsigned long long MASCARA_OP = 3;
+
+ReactorUring::ReactorUring(int serverSocket)
+    : serverSocket(serverSocket), ringFd(-1), sqMem(MAP_FAILED), sqMemSize(0),
+      cqMem(MAP_FAILED), cqMemSize(0), sqes(nullptr), sqesSize(0), sqPreparadas(0),
+      memoriaBuffers(nullptr) {
+    if (!crearAnillo(ENTRADAS_ANILLO) || !soportaOperaciones()) {
+        return;
+    }
+    proporcionarBuffers();
+}
+
+ReactorUring::~ReactorUring() {
+    delete[] memoriaBuffers;
+    if (sqes != nullptr) {
+        munmap(sqes, sqesSize);
+    }
+    if (cqMem != MAP_FAILED && cqMem != sqMem) {
+        munmap(cqMem, cqMemSize);
+    }
+    if (sqMem != MAP_FAILED) {
+        munmap(sqMem, sqMemSize);
+    }
+    if (ringFd >= 0) {
+        close(ringFd);
+    }
+}
+
+bool ReactorUring::crearAnillo(unsigned entradas) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    ringFd = syscall(__NR_io_uring_setup, entradas, &params);
+    if (ringFd < 0 && errno == EINVAL) {
+        // Kernel anterior a 6.0: sin esas optimizaciones
+        memset(&params, 0, sizeof(params));
+        ringFd = syscall(__NR_io_uring_setup, entradas, &params);
+    }
+    if (ringFd < 0) {
+        return false;
+    }
+
+    sqMemSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqMemSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sqMemSize = cqMemSize = max(sqMemSize, cqMemSize);
+    }
+
+    sqMem = mmap(nullptr, sqMemSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 ringFd, IORING_OFF_SQ_RING);
+    if (sqMem == MAP_FAILED) {
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cqMem = sqMem;
+    } else {
+        cqMem = mmap(nullptr, cqMemSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ringFd, IORING_OFF_CQ_RING);
+        if (cqMem == MAP_FAILED) {
+            return false;
+        }
+    }
+
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* memSqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ringFd, IORING_OFF_SQES);
+    if (memSqes == MAP_FAILED) {
+        return false;
+    }
+    sqes = static_cast<struct io_uring_sqe*>(memSqes);
+
+    char* sq = static_cast<char*>(sqMem);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(cqMem);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // Cada posición del anillo apunta siempre a la SQE con el mismo índice
+    for (unsigned i = 0; i < params.sq_entries; ++i) {
+        sqArray[i] = i;
+    }
+    return true;
+}
+
+// Pregunta al kernel qué operaciones admite. IORING_OP_SOCKET llegó en 5.19,
+// la misma versión que el accept multishot, que no se puede consultar aparte
+bool ReactorUring::soportaOperaciones() {
+    const int maxOps = 256;
+    vector<char> mem(sizeof(struct io_uring_probe) + maxOps * sizeof(struct io_uring_probe_op), 0);
+    struct io_uring_probe* probe = reinterpret_cast<struct io_uring_probe*>(mem.data());
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, maxOps) < 0) {
+        return false;
+    }
+
+    const int necesarias[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG,
+                               IORING_OP_PROVIDE_BUFFERS, IORING_OP_SOCKET };
+    for (int op : necesarias) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Entrega al kernel todos los buffers de recepción
+void ReactorUring::proporcionarBuffers() {
+    memoriaBuffers = new char[NUM_BUFFERS * TAM_BUFFER];
+
+    struct io_uring_sqe* sqe = nuevaSqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = NUM_BUFFERS;
+    sqe->addr = reinterpret_cast<unsigned long long>(memoriaBuffers);
+    sqe->len = TAM_BUFFER;
+    sqe->off = 0;
+    sqe->buf_group = GRUPO_BUFFERS;
+    sqe->user_data = OP_BUFFERS;
+}
+
+// Devuelve un buffer ya procesado. Va en el mismo io_uring_enter que el
+// resto de peticiones del lote y delante del recv que se vuelva a armar
+void ReactorUring::devolverBuffer(unsigned short bid) {
+    struct io_uring_sqe* sqe = nuevaSqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = 1;
+    sqe->addr = reinterpret_cast<unsigned long long>(memoriaBuffers + bid * TAM_BUFFER);
+    sqe->len = TAM_BUFFER;
+    sqe->off = bid;
+    sqe->buf_group = GRUPO_BUFFERS;
+    sqe->user_data = OP_BUFFERS;
+}
+
+struct io_uring_sqe* ReactorUring::nuevaSqe() {
+    unsigned tail = *sqTail;
+    if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) > *sqMask) {
+        // Anillo lleno: entregar lo preparado sin esperar completados
+        entregar(0);
+    }
+    struct io_uring_sqe* sqe = &sqes[tail & *sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    sqPreparadas++;
+    return sqe;
+}
+
+// Entrega al kernel las SQEs preparadas y espera a 'esperar' completados
+int ReactorUring::entregar(unsigned esperar) {
+    int r = syscall(__NR_io_uring_enter, ringFd, sqPreparadas, esperar,
+                    esperar > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+    if (r >= 0) {
+        sqPreparadas -= r;
+    }
+    return r;
+}
+
+void ReactorUring::armarAccept() {
+    struct io_uring_sqe* sqe = nuevaSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = serverSocket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = OP_ACCEPT;
+}
+
+void ReactorUring::armarRecv(ClienteUring& cliente) {
+    struct io_uring_sqe* sqe = nuevaSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = cliente.conexion->socket;
+    sqe->len = TAM_BUFFER;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = GRUPO_BUFFERS;
+    sqe->user_data = reinterpret_cast<unsigned long long>(&cliente) | OP_RECV;
+    cliente.operaciones++;
+}
+
+// Un sendmsg con un iovec por mensaje: los mensajes compartidos no se copian
+void ReactorUring::armarSend(ClienteUring& cliente) {
+    memset(&cliente.msg, 0, sizeof(cliente.msg));
+    cliente.msg.msg_iov = cliente.iov;
+    cliente.msg.msg_iovlen = prepararIovecs(cliente.enVuelo, cliente.offset,
+                                            cliente.iov, MAX_IOV_ENVIO);
+
+    struct io_uring_sqe* sqe = nuevaSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = cliente.conexion->socket;
+    sqe->addr = reinterpret_cast<unsigned long long>(&cliente.msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = reinterpret_cast<unsigned long long>(&cliente) | OP_SEND;
+    cliente.operaciones++;
+}
+
+void ReactorUring::programarEnvio(Conexion& conexion) {
+    // Todas las conexiones de este backend se atienden en el hilo del bucle
+    pendientesEnvio.push_back(conexion.id);
+}
+
+// Pasa los mensajes de la cola de salida a enVuelo para el siguiente sendmsg.
+// Devuelve false si no hay nada
+static bool tomarPendiente(Conexion& conexion, deque<MensajePtr>& enVuelo) {
+    lock_guard<mutex> lock(conexion.salidaMutex);
+    enVuelo.swap(conexion.colaSalida);
+    conexion.colaSalida.clear();
+    conexion.envioProgramado = false;
+    return !enVuelo.empty();
+}
+
+// Prepara un send por cada cliente con datos nuevos y sin send en curso
+void ReactorUring::prepararEnvios() {
+    vector<int> ids;
+    ids.swap(pendientesEnvio);
+    for (int id : ids) {
+        auto it = clientes.find(id);
+        if (it == clientes.end()) {
+            continue;
+        }
+        ClienteUring& cliente = *it->second;
+        if (cliente.cerrado || !cliente.enVuelo.empty()) {
+            continue;  // El send en curso recogerá lo nuevo al terminar
+        }
+        cliente.offset = 0;
+        if (tomarPendiente(*cliente.conexion, cliente.enVuelo)) {
+            armarSend(cliente);
+        } else if (cliente.cerrando) {
+            cerrarCliente(cliente);
+            liberarSiTerminado(cliente);
+        }
+    }
+}
+
+void ReactorUring::ejecutar() {
+    armarAccept();
+
+    while (true) {
+        prepararEnvios();
+
+        // Una sola llamada al sistema entrega todo y espera completados
+        if (entregar(1) < 0 && errno != EINTR && errno != EBUSY) {
+            logTexto(LOG_ERROR, string("[ERROR] io_uring_enter: ") + strerror(errno));
+            return;
+        }
+
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe cqe = cqes[head & *cqMask];
+            head++;
+            completado(cqe);
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+}
+
+void ReactorUring::completado(const struct io_uring_cqe& cqe) {
+    unsigned long long op = cqe.user_data & MASCARA_OP;
+
+    if (op == OP_BUFFERS) {
+        if (cqe.res < 0) {
+            logTexto(LOG_ERROR, string("[ERROR] Fallo al devolver buffers: ") + strerror(-cqe.res));
+        }
+        return;
+    }
+
+    if (op == OP_ACCEPT) {
+        if (cqe.res >= 0) {
+            nuevoCliente(cqe.res);
+        } else {
+            logTexto(LOG_ERROR, string("[ERROR] Fallo al aceptar conexión: ") + strerror(-cqe.res));
+        }
+        // El accept multishot sigue activo mientras el kernel marque F_MORE
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            armarAccept();
+        }
+        return;
+    }
+
+    ClienteUring& cliente = *reinterpret_cast<ClienteUring*>(cqe.user_data & ~MASCARA_OP);
+    cliente.operaciones--;
+
+    if (op == OP_RECV) {
+        bool recibido = cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER);
+        bool seguir = true;
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            unsigned short bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+            if (recibido && !cliente.cerrado && !cliente.cerrando) {
+                // Las líneas se procesan directamente desde el buffer del
+                // kernel; solo una línea incompleta se guarda en la conexión
+                Conexion& conexion = *cliente.conexion;
+                seguir = conexion.entrada.consumir(memoriaBuffers + bid * TAM_BUFFER, cqe.res,
+                    [&conexion](const char* linea, size_t longitud) {
+                        return procesarMensaje(conexion, linea, longitud);
+                    });
+            }
+            devolverBuffer(bid);
+        }
+
+        if (cliente.cerrado || cliente.cerrando) {
+            // Lectura que ya no interesa
+        } else if (cqe.res == -ENOBUFS) {
+            armarRecv(cliente);  // Se devuelven buffers en este mismo lote
+        } else if (!recibido) {
+            // Cliente desconectado o error
+            logEvento(LOG_INFO, EVENTO_DESCONEXION, cliente.conexion->id);
+            cerrarCliente(cliente);
+        } else if (seguir) {
+            armarRecv(cliente);
+        } else {
+            // "exit": se cierra cuando se haya enviado la respuesta
+            cliente.cerrando = true;
+            if (!cliente.conexion->envioProgramado && cliente.enVuelo.empty()) {
+                cerrarCliente(cliente);
+            }
+        }
+    } else if (op == OP_SEND && !cliente.cerrado) {
+        if (cqe.res < 0) {
+            cerrarCliente(cliente);
+        } else {
+            consumirEnviados(cliente.enVuelo, cliente.offset, cqe.res);
+            if (!cliente.enVuelo.empty()) {
+                armarSend(cliente);  // Escritura parcial o más de MAX_IOV_ENVIO mensajes
+            } else {
+                if (tomarPendiente(*cliente.conexion, cliente.enVuelo)) {
+                    armarSend(cliente);
+                } else if (cliente.cerrando) {
+                    cerrarCliente(cliente);
+                }
+            }
+        }
+    }
+
+    liberarSiTerminado(cliente);
+}
+
+void ReactorUring::nuevoCliente(int clientSocket) {
+    int id = nuevoIdCliente();
+    unique_ptr<ClienteUring> cliente(new ClienteUring());
+    cliente->conexion = make_shared<Conexion>(clientSocket, id, this);
+    cliente->offset = 0;
+    cliente->operaciones = 0;
+    cliente->cerrando = false;
+    cliente->cerrado = false;
+
+    ClienteUring& ref = *cliente;
+    clientes[id] = std::move(cliente);
+    armarRecv(ref);
+    if (!conectarCliente(ref.conexion)) {
+        cerrarCliente(ref);  // El recv armado termina con el shutdown y libera al cliente
+    }
+}
+
+void ReactorUring::cerrarCliente(ClienteUring& cliente) {
+    if (cliente.cerrado) {
+        return;
+    }
+    cliente.cerrado = true;
+    // Las operaciones en curso conservan el socket abierto en el kernel:
+    // shutdown hace que terminen antes de cerrarlo
+    shutdown(cliente.conexion->socket, SHUT_RDWR);
+    desconectarCliente(cliente.conexion);
+}
+
+void ReactorUring::liberarSiTerminado(ClienteUring& cliente) {
+    if (cliente.cerrado && cliente.operaciones == 0) {
+        clientes.erase(cliente.conexion->id);
+    }
+}
+
+bool ejecutarServidorUring(int serverSocket) {
+    ReactorUring reactor(serverSocket);
+    if (!reactor.iniciado()) {
+        return false;
+    }
+    reactor.ejecutar();
+    return true;
+}
@@ -0,0 +1,104 @@
+/*
+ * reactorUring.h - Backend io_uring para el servidor de chat
+ *
+ * Un único hilo atiende todos los clientes sobre un anillo io_uring:
+ * - accept multishot: una sola petición acepta todas las conexiones
+ * - recv con buffers proporcionados: el kernel elige el buffer al llegar datos,
+ *   así los clientes inactivos no tienen memoria de recepción reservada
+ * - los envíos que generan broadcast y respuestas se acumulan y se entregan
+ *   al kernel en un solo io_uring_enter por vuelta del bucle; cada cliente
+ *   recibe su cola con un sendmsg que apunta a los mensajes compartidos
+ *
+ * Se usa la interfaz de llamadas al sistema directamente (sin liburing).
+ */
+
+#ifndef _REACTOR_URING_H_
+#define _REACTOR_URING_H_
+
+#include "chat.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+static const int MAX_IOV_ENVIO = 64;  // Mensajes por sendmsg
+
+class ReactorUring : public BackendEnvio {
+
+public:
+    explicit ReactorUring(int serverSocket);
+    ~ReactorUring();
+
+    // false si el kernel no admite io_uring o el accept multishot (Linux < 5.19)
+    bool iniciado() const { return ringFd >= 0 && memoriaBuffers != nullptr; }
+
+    // Bucle principal (no retorna salvo error)
+    void ejecutar();
+
+    void programarEnvio(Conexion& conexion) override;
+
+private:
+    // Estado de io_uring de cada cliente
+    struct ClienteUring {
+        ConexionPtr conexion;
+        std::deque<MensajePtr> enVuelo;     // Mensajes del sendmsg en curso
+        size_t offset;                      // Bytes ya escritos del primero
+        struct iovec iov[MAX_IOV_ENVIO];    // Deben seguir válidos hasta el completado
+        struct msghdr msg;
+        int operaciones;        // recv/send en curso que apuntan a este cliente
+        bool cerrando;          // Se cierra al terminar lo pendiente
+        bool cerrado;           // Ya se llamó a desconectarCliente
+    };
+
+    int serverSocket;
+    int ringFd;
+
+    // Anillo de envío (SQ) y de completado (CQ) mapeados en memoria
+    void* sqMem;
+    size_t sqMemSize;
+    void* cqMem;
+    size_t cqMemSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+    unsigned sqPreparadas;  // SQEs escritas y no entregadas al kernel
+
+    // Buffers proporcionados para recv (NUM_BUFFERS bloques contiguos)
+    char* memoriaBuffers;
+
+    std::map<int, std::unique_ptr<ClienteUring>> clientes;  // Por ID de cliente
+    std::vector<int> pendientesEnvio;                         // IDs con datos nuevos
+
+    bool crearAnillo(unsigned entradas);
+    bool soportaOperaciones();
+    void proporcionarBuffers();
+    struct io_uring_sqe* nuevaSqe();
+    int entregar(unsigned esperar);
+
+    void armarAccept();
+    void armarRecv(ClienteUring& cliente);
+    void armarSend(ClienteUring& cliente);
+    void devolverBuffer(unsigned short bid);
+
+    void completado(const struct io_uring_cqe& cqe);
+    void nuevoCliente(int clientSocket);
+    void cerrarCliente(ClienteUring& cliente);
+    void liberarSiTerminado(ClienteUring& cliente);
+    void prepararEnvios();
+};
+
+// Ejecuta el servidor con io_uring. Devuelve false si no se pudo iniciar
+bool ejecutarServidorUring(int serverSocket);
+
+#endif
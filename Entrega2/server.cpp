@@ -2,11 +2,38 @@
  * server.cpp - Servidor TCP multi-cliente con broadcast
  *
  * Funcionalidades:
- * - Acepta múltiples clientes simultáneos (un hilo por cliente)
- * - Broadcast: reenvía mensajes a todos los clientes excepto al emisor
+ * - Acepta múltiples clientes simultáneos
+ * - Modos de E/S seleccionables con --modo:
+ *     hilos: un hilo por cliente (por defecto)
+ *     epoll: reactores epoll no bloqueantes en un número fijo de hilos (--reactores N),
+ *            cada uno con su socket de escucha (SO_REUSEPORT) y sus clientes
+ *     uring: un hilo con io_uring; si el kernel no lo admite se usa epoll
+ * - Broadcast: reenvía mensajes a los clientes de la sala del emisor excepto
+ *   a él. Todos empiezan en la sala "general"
+ * - Comandos "unirse <sala>" (la crea si no existe), "abandonar" (vuelve a
+ *   general) y "salas" (salas con miembros)
+ * - Historial: al entrar en una sala se reciben sus últimos mensajes, hasta
+ *   --historial N bytes por sala (16384 por defecto, 0 lo desactiva)
+ * - Comando "privado <id> <mensaje>": solo al cliente con ese ID
  * - Comando "usuarios": lista los IDs de clientes conectados
+ * - Comando "estadisticas": mensajes perdidos por clientes lentos
+ * - Cola de salida acotada por cliente (--cola N mensajes); el broadcast solo
+ *   encola y, si la cola está llena, se aplica --politica:
+ *     antiguo: se descarta el mensaje más antiguo pendiente
+ *     nuevo: se descarta el mensaje nuevo
+ *     desconectar: se desconecta al cliente lento (por defecto)
  * - Comando "exit": desconecta al cliente que lo envía
  * - Puerto configurable por argumento (default: 5000)
+ * - Log asíncrono (log.h): los hilos de clientes no escriben en consola.
+ *     --log-nivel debug|info|aviso|error (por defecto info)
+ *     --log archivo: texto en un archivo en vez de la salida estándar
+ *     --log-binario archivo: entradas sin formato, se leen con --ver-log
+ *     --ver-log archivo: muestra un log binario como texto y termina
+ *
+ * Uso: ./server [puerto] [--modo hilos|epoll|uring] [--reactores N]
+ *            [--cola N] [--politica antiguo|nuevo|desconectar] [--historial N]
+ *            [--log-nivel nivel] [--log archivo | --log-binario archivo]
+ *       ./server --ver-log archivo
  */
 
 #include <iostream>
@@ -14,164 +41,248 @@
 #include <vector>
 #include <thread>
 #include <mutex>
-#include <atomic>
+#include <future>
+#include <chrono>
+#include <cerrno>
 #include <cstring>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
-#include <algorithm>
+#include <sys/uio.h>
+#include <deque>
+
+#include "chat.h"
+#include "log.h"
+#include "reactorEpoll.h"
+#include "reactorUring.h"
 
 using namespace std;
 
-// Variables globales para gestión de clientes
-struct ClienteInfo {
-    int socket;
-    int id;
+// Backend del modo "hilos": cada cliente tiene un hilo escritor que espera
+// en hayDatos y vacía su cola con send bloqueante
+class BackendHilos : public BackendEnvio {
+public:
+    void programarEnvio(Conexion& conexion) override {
+        conexion.hayDatos.notify_one();
+    }
 };
 
-vector<ClienteInfo> clientesConectados;  // Lista de clientes activos
-mutex clientesMutex;                     // Protege acceso a clientesConectados
-atomic<int> contadorClientes(0);         // Contador de IDs de clientes
-mutex coutMutex;                         // Protege salida a consola
-
-// Función para eliminar saltos de línea al final de una cadena
-string trim(const string& str) {
-    size_t end = str.find_last_not_of("\r\n");
-    return (end == string::npos) ? "" : str.substr(0, end + 1);
-}
+BackendHilos backendHilos;
 
-// Función para agregar un cliente a la lista global
-void agregarCliente(int socket, int id) {
-    lock_guard<mutex> lock(clientesMutex);
-    clientesConectados.push_back({socket, id});
-}
+static const size_t MIN_LECTURA = 1024;  // Hueco mínimo para cada recv
+static const chrono::seconds ESPERA_DESPEDIDA(5);  // Para enviar lo pendiente tras "exit"
+static const unsigned ANILLO_LOG_CLIENTE = 64;     // Entradas de log por hilo de cliente (8 KiB)
 
-// Función para eliminar un cliente de la lista global
-void eliminarCliente(int id) {
-    lock_guard<mutex> lock(clientesMutex);
-    clientesConectados.erase(
-        remove_if(clientesConectados.begin(), clientesConectados.end(),
-                  [id](const ClienteInfo& c) { return c.id == id; }),
-        clientesConectados.end()
-    );
-}
+// Hilo escritor de un cliente: se lleva todos los mensajes encolados y los
+// envía con sendmsg (varios mensajes por llamada al sistema)
+void escribirCliente(ConexionPtr conexion) {
+    const int maxIov = 64;
+    struct iovec iov[maxIov];
+    deque<MensajePtr> lote;
 
-// Función para hacer broadcast de un mensaje a todos excepto al emisor
-void broadcast(const string& mensaje, int idEmisor) {
-    lock_guard<mutex> lock(clientesMutex);
-    for (const auto& cliente : clientesConectados) {
-        if (cliente.id != idEmisor) {
-            send(cliente.socket, mensaje.c_str(), mensaje.length(), 0);
+    unique_lock<mutex> lock(conexion->salidaMutex);
+    while (true) {
+        conexion->hayDatos.wait(lock, [&conexion]() {
+            return !conexion->colaSalida.empty() || conexion->finSalida || conexion->desbordada;
+        });
+        if (conexion->colaSalida.empty() || conexion->desbordada) {
+            break;  // Fin de la conexión y nada más que enviar
         }
-    }
-}
 
-// Función para obtener la lista de IDs conectados
-string obtenerListaUsuarios() {
-    lock_guard<mutex> lock(clientesMutex);
-    if (clientesConectados.empty()) {
-        return "conectados: ninguno";
-    }
-
-    string lista = "conectados: ";
-    for (size_t i = 0; i < clientesConectados.size(); ++i) {
-        lista += to_string(clientesConectados[i].id);
-        if (i < clientesConectados.size() - 1) {
-            lista += ",";
+        lote.swap(conexion->colaSalida);
+        conexion->envioProgramado = false;
+
+        // El envío bloqueante se hace sin el cerrojo para no frenar a quien encola
+        lock.unlock();
+        size_t offset = 0;
+        while (!lote.empty()) {
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = prepararIovecs(lote, offset, iov, maxIov);
+            ssize_t n = sendmsg(conexion->socket, &msg, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return;  // Socket roto: el hilo lector se encarga del cierre
+            }
+            consumirEnviados(lote, offset, n);
         }
+        lock.lock();
     }
-    return lista;
 }
 
 // Función que maneja la comunicación con un cliente específico
-// Se ejecuta en un hilo separado
+// Se ejecuta en un hilo separado (modo "hilos")
 void manejarCliente(int clientSocket, int clientId) {
-    char buffer[1024];
-
-    {
-        lock_guard<mutex> lock(coutMutex);
-        cout << "[SERVIDOR] Cliente " << clientId << " conectado (socket: "
-             << clientSocket << ")" << endl;
-    }
-
-    // Agregar cliente a la lista global
-    agregarCliente(clientSocket, clientId);
-
-    // Notificar a otros clientes
-    string mensajeConexion = "cliente " + to_string(clientId) + " se ha conectado\n";
-    broadcast(mensajeConexion, clientId);
-
-    // Bucle principal: recibir y procesar mensajes
-    while (true) {
-        memset(buffer, 0, sizeof(buffer));
-
-        int bytesRecibidos = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+    bool pidioSalir = false;
+    tamanoAnilloLog(ANILLO_LOG_CLIENTE);
+
+    ConexionPtr conexion = make_shared<Conexion>(clientSocket, clientId, &backendHilos);
+    promise<void> escritorTermina;
+    future<void> escritorTerminado = escritorTermina.get_future();
+    thread escritor([conexion, &escritorTermina]() {
+        escribirCliente(conexion);
+        escritorTermina.set_value();
+    });
+    bool registrado = conectarCliente(conexion);
+
+    // Bucle principal: recibir y procesar mensajes. Un recv puede traer
+    // varias líneas o solo parte de una: se procesan todas las completas
+    while (registrado) {
+        size_t disponible;
+        char* hueco = conexion->entrada.hueco(MIN_LECTURA, disponible);
+        int bytesRecibidos = recv(clientSocket, hueco, disponible, 0);
 
         if (bytesRecibidos <= 0) {
             // Cliente desconectado o error
-            lock_guard<mutex> lock(coutMutex);
-            cout << "[SERVIDOR] Cliente " << clientId << " desconectado" << endl;
+            logEvento(LOG_INFO, EVENTO_DESCONEXION, clientId);
             break;
         }
 
-        buffer[bytesRecibidos] = '\0';
-        string mensaje = trim(string(buffer));
-
-        // Mostrar mensaje en consola del servidor
-        {
-            lock_guard<mutex> lock(coutMutex);
-            cout << "cliente " << clientId << ": " << mensaje << endl;
-        }
-
-        // Procesar comandos especiales
-        if (mensaje == "exit") {
-            // Cliente solicita desconexión
-            string respuesta = "Servidor: desconectando...\n";
-            send(clientSocket, respuesta.c_str(), respuesta.length(), 0);
+        bool seguir = conexion->entrada.confirmar(bytesRecibidos,
+            [&conexion](const char* linea, size_t longitud) {
+                return procesarMensaje(*conexion, linea, longitud);
+            });
+        if (!seguir) {
+            pidioSalir = true;
             break;
         }
-        else if (mensaje == "usuarios") {
-            // Listar usuarios conectados
-            string listaUsuarios = obtenerListaUsuarios() + "\n";
-            send(clientSocket, listaUsuarios.c_str(), listaUsuarios.length(), 0);
-        }
-        else {
-            // Mensaje normal: hacer broadcast a otros clientes
-            string mensajeBroadcast = "cliente " + to_string(clientId) + ": " + mensaje + "\n";
-            broadcast(mensajeBroadcast, clientId);
+    }
 
-            // Enviar ACK al emisor
-            string ack = "Servidor: mensaje recibido correctamente.\n";
-            send(clientSocket, ack.c_str(), ack.length(), 0);
-        }
+    // El escritor acaba al vaciar la cola (ya no se encola nada más). Tras
+    // "exit" se le deja un tiempo para enviar lo que quede; después, o si el
+    // cliente se fue, shutdown desbloquea un send que pudiera estar esperando
+    // a un cliente que no lee, así que el join nunca se queda colgado
+    {
+        lock_guard<mutex> lock(conexion->salidaMutex);
+        conexion->finSalida = true;
     }
+    conexion->hayDatos.notify_one();
+    if (pidioSalir) {
+        escritorTerminado.wait_for(ESPERA_DESPEDIDA);
+    }
+    shutdown(clientSocket, SHUT_RDWR);
+    escritor.join();
+
+    desconectarCliente(conexion);
+}
+
+// Bucle de accept del modo "hilos": un hilo por cliente
+void ejecutarServidorHilos(int serverSocket) {
+    while (true) {
+        struct sockaddr_in clientAddr;
+        socklen_t clientAddrLen = sizeof(clientAddr);
+
+        int clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientAddrLen);
+
+        if (clientSocket < 0) {
+            logTexto(LOG_ERROR, string("[ERROR] Fallo al aceptar conexión: ") + strerror(errno));
+            continue;
+        }
 
-    // Limpiar y cerrar
-    eliminarCliente(clientId);
-    close(clientSocket);
+        // Asignar ID único al cliente
+        int clientId = nuevoIdCliente();
 
-    // Notificar desconexión a otros clientes
-    string mensajeDesconexion = "cliente " + to_string(clientId) + " se ha desconectado\n";
-    broadcast(mensajeDesconexion, clientId);
+        // Crear hilo para manejar este cliente
+        thread hiloCliente(manejarCliente, clientSocket, clientId);
+        hiloCliente.detach();  // Independizar el hilo
+    }
 }
 
 // Función principal del servidor
 int main(int argc, char** argv) {
-    // Configurar puerto (default: 5000)
+    // Configurar puerto (default: 5000), modo de E/S y número de reactores
     int puerto = 5000;
-    if (argc >= 2) {
-        puerto = atoi(argv[1]);
-        if (puerto <= 0 || puerto > 65535) {
-            cerr << "Puerto inválido. Usando puerto por defecto: 5000" << endl;
-            puerto = 5000;
+    string modo = "hilos";
+    int capacidadCola = 1024;
+    PoliticaCola politica = DESCONECTAR;
+    int bytesHistorial = 16 * 1024;
+    NivelLog nivelLog = LOG_INFO;
+    string archivoLog;
+    bool logBinario = false;
+    int numReactores = thread::hardware_concurrency();
+    if (numReactores <= 0) {
+        numReactores = 1;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--modo" && i + 1 < argc) {
+            modo = argv[++i];
+        }
+        else if (arg == "--reactores" && i + 1 < argc) {
+            numReactores = atoi(argv[++i]);
+            if (numReactores <= 0) {
+                cerr << "Número de reactores inválido. Usando 1" << endl;
+                numReactores = 1;
+            }
+        }
+        else if (arg == "--cola" && i + 1 < argc) {
+            capacidadCola = atoi(argv[++i]);
+            if (capacidadCola <= 0) {
+                cerr << "Tamaño de cola inválido. Usando 1024" << endl;
+                capacidadCola = 1024;
+            }
         }
+        else if (arg == "--historial" && i + 1 < argc) {
+            bytesHistorial = atoi(argv[++i]);
+            if (bytesHistorial < 0) {
+                cerr << "Tamaño de historial inválido. Usando 16384" << endl;
+                bytesHistorial = 16 * 1024;
+            }
+        }
+        else if (arg == "--politica" && i + 1 < argc) {
+            if (!politicaDesdeTexto(argv[++i], politica)) {
+                cerr << "Política desconocida: " << argv[i] << " (usa antiguo, nuevo o desconectar)" << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--log-nivel" && i + 1 < argc) {
+            if (!nivelDesdeTexto(argv[++i], nivelLog)) {
+                cerr << "Nivel de log desconocido: " << argv[i] << " (usa debug, info, aviso o error)" << endl;
+                return 1;
+            }
+        }
+        else if ((arg == "--log" || arg == "--log-binario") && i + 1 < argc) {
+            archivoLog = argv[++i];
+            logBinario = (arg == "--log-binario");
+        }
+        else if (arg == "--ver-log" && i + 1 < argc) {
+            if (!formatearLogBinario(argv[++i], cout)) {
+                cerr << "No es un log binario válido: " << argv[i] << endl;
+                return 1;
+            }
+            return 0;
+        }
+        else {
+            puerto = atoi(argv[i]);
+            if (puerto <= 0 || puerto > 65535) {
+                cerr << "Puerto inválido. Usando puerto por defecto: 5000" << endl;
+                puerto = 5000;
+            }
+        }
+    }
+
+    if (modo != "hilos" && modo != "epoll" && modo != "uring") {
+        cerr << "Modo desconocido: " << modo << " (usa hilos, epoll o uring)" << endl;
+        return 1;
     }
 
+    configurarColaSalida(capacidadCola, politica);
+    configurarHistorial(bytesHistorial);
+
     cout << "============================================" << endl;
     cout << "  SERVIDOR TCP MULTI-CLIENTE CON BROADCAST" << endl;
     cout << "============================================" << endl;
     cout << "Puerto: " << puerto << endl;
+    cout << "Modo: " << modo;
+    if (modo == "epoll") {
+        cout << " (" << numReactores << " reactores)";
+    }
+    cout << endl;
+    cout << "Cola de salida: " << capacidadCola << " mensajes, política "
+         << textoPolitica(politica) << endl;
+    cout << "Historial: " << bytesHistorial << " bytes por sala" << endl;
     cout << "============================================" << endl;
 
     // Crear socket del servidor
@@ -181,10 +292,11 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    // Configurar reutilización de dirección
+    // Configurar reutilización de dirección. SO_REUSEPORT permite que cada
+    // reactor epoll abra su propio socket de escucha en el mismo puerto
     int opcion = 1;
-    if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT,
-                   &opcion, sizeof(opcion)) < 0) {
+    if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opcion, sizeof(opcion)) < 0 ||
+        setsockopt(serverSocket, SOL_SOCKET, SO_REUSEPORT, &opcion, sizeof(opcion)) < 0) {
         cerr << "Error en setsockopt" << endl;
         close(serverSocket);
         return 1;
@@ -205,7 +317,7 @@ int main(int argc, char** argv) {
     }
 
     // Escuchar conexiones entrantes
-    if (listen(serverSocket, 10) < 0) {
+    if (listen(serverSocket, SOMAXCONN) < 0) {
         cerr << "Error al hacer listen" << endl;
         close(serverSocket);
         return 1;
@@ -215,26 +327,28 @@ int main(int argc, char** argv) {
     cout << "[SERVIDOR] Esperando conexiones de clientes..." << endl;
     cout << "============================================" << endl << endl;
 
-    // Bucle principal: aceptar conexiones
-    while (true) {
-        struct sockaddr_in clientAddr;
-        socklen_t clientAddrLen = sizeof(clientAddr);
-
-        int clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientAddrLen);
+    // A partir de aquí la consola es del hilo de log: todo pasa por él
+    if (!iniciarLog(nivelLog, archivoLog, logBinario)) {
+        cerr << "No se pudo abrir el archivo de log " << archivoLog << ": " << strerror(errno) << endl;
+        close(serverSocket);
+        return 1;
+    }
 
-        if (clientSocket < 0) {
-            cerr << "[ERROR] Fallo al aceptar conexión" << endl;
-            continue;
+    // Bucle principal: aceptar y atender conexiones
+    if (modo == "uring") {
+        if (!ejecutarServidorUring(serverSocket)) {
+            logTexto(LOG_AVISO, "[SERVIDOR] io_uring no disponible en este kernel, usando epoll");
+            ejecutarServidorEpoll(serverSocket, numReactores);
         }
-
-        // Asignar ID único al cliente
-        int clientId = ++contadorClientes;
-
-        // Crear hilo para manejar este cliente
-        thread hiloCliente(manejarCliente, clientSocket, clientId);
-        hiloCliente.detach();  // Independizar el hilo
+    }
+    else if (modo == "epoll") {
+        ejecutarServidorEpoll(serverSocket, numReactores);
+    }
+    else {
+        ejecutarServidorHilos(serverSocket);
     }
 
+    detenerLog();
     close(serverSocket);
     return 0;
 }
\ No newline at end of file
@@ -156,27 +156,24 @@ inline void packv(std::vector<unsigned char> &packet,T* data,int dataSize)
 
 
 
+//lectura desde offset, que avanza lo leído: el paquete no se modifica, así
+//que desempaquetar n campos no mueve el resto del paquete en cada llamada
 template<typename T>
-inline T unpack(std::vector<unsigned char> &packet){	
+inline T unpack(const std::vector<unsigned char> &packet,size_t &offset){
 	T data;
-	long int dataSize=sizeof(T);
-	int packetSize=packet.size();
-	memcpy(&data,packet.data(),dataSize);
-	memcpy(packet.data(),packet.data()+dataSize,packetSize-dataSize);
-	packet.resize(packetSize-dataSize);
+	memcpy(&data,packet.data()+offset,sizeof(T));
+	offset+=sizeof(T);
 	return data;
 }
 
 
 
 template<typename T>
-inline void unpackv(std::vector<unsigned char> &packet,T* data,int dataSize)
+inline void unpackv(const std::vector<unsigned char> &packet,size_t &offset,T* data,int dataSize)
 {
 	dataSize*=sizeof(T);
-	int packetSize=packet.size();
-	memcpy(data,packet.data(),dataSize);
-	memcpy(packet.data(),packet.data()+dataSize,packetSize-dataSize);
-	packet.resize(packetSize-dataSize);
+	memcpy(data,packet.data()+offset,dataSize);
+	offset+=dataSize;
 }
 
 #endif
\ No newline at end of file